@@ -10,9 +10,14 @@ Args::Args(int argc, char* argv[]) : argc(argc), argv(argv) {
 void Args::printUsage() {
     std::cout << "Usage: csv_to_sqlite --input <input_file> --type <type> --date <date>\n"
               << "\nRequired Arguments:\n"
-              << "  --input <input_file>  : Input file to process\n"
+              << "  --input <input_file>  : Input file to process, - for stdin\n"
               << "  --type  <type>        : Specify the type for processing\n"
               << "  --date  <date>        : Specify the date (format: YYYYMMDD)\n"
+              << "\nOptional Arguments:\n"
+              << "  --sorted              : Sort by (type, date, timestamp) and append to the clustered trades table\n"
+              << "  --sort-memory <MiB>   : Memory for in-memory sorted runs before spilling to disk (default 256)\n"
+              << "  --staging             : Load through per-thread in-memory databases, merged at the end\n"
+              << "  --threads <n>         : Worker threads (default: one per CPU)\n"
               << "\nExample:\n"
               << "  csv_to_sqlite --input trades.csv --type TSLA --date 20241016\n";
 }
@@ -28,6 +33,10 @@ void Args::validateArgs() const {
     if (!type.has_value()) missingArgs.push_back("--type");
     if (!date.has_value()) missingArgs.push_back("--date");
 
+    if (staging && sorted) {
+        throw std::runtime_error("Error: --staging and --sorted cannot be combined");
+    }
+
     if (!missingArgs.empty()) {
         std::string error = "Missing required arguments:";
         for (const auto& arg : missingArgs) {
@@ -60,11 +69,42 @@ void Args::parseArg(const std::string& arg, int& i) {
         } else {
             throw std::runtime_error("Error: Missing value after --date");
         }
+    } else if (arg == "--sorted") {
+        sorted = true;
+    } else if (arg == "--staging") {
+        staging = true;
+    } else if (arg == "--sort-memory") {
+        if (i + 1 < argc) {
+            // Up to 1 TiB, so the byte count cannot overflow
+            sortMemoryMB = parseCount(arg, argv[++i], 1, 1L << 20);
+        } else {
+            throw std::runtime_error("Error: Missing value after --sort-memory");
+        }
+    } else if (arg == "--threads") {
+        if (i + 1 < argc) {
+            threads = static_cast<int>(parseCount(arg, argv[++i], 0, 1024));
+        } else {
+            throw std::runtime_error("Error: Missing value after --threads");
+        }
     } else {
         throw std::runtime_error("Error: Unknown option: " + arg);
     }
 }
 
+long Args::parseCount(const std::string& option, const std::string& value, long min, long max) {
+    // Plain decimal only, no sign, suffix or trailing garbage
+    std::string error = "Error: " + option + " expects a number from " + std::to_string(min) +
+                        " to " + std::to_string(max) + ", got '" + value + "'";
+    if (value.empty() || value.size() > 18 || value.find_first_not_of("0123456789") != std::string::npos) {
+        throw std::runtime_error(error);
+    }
+    long number = std::stol(value);
+    if (number < min || number > max) {
+        throw std::runtime_error(error);
+    }
+    return number;
+}
+
 void Args::parse() {
     for (int i = 1; i < argc; ++i) {
         std::string arg(argv[i]);
@@ -13,6 +13,14 @@ public:
     std::optional<std::string> type;
     std::optional<std::string> date;
 
+    // Sorted bulk load into the clustered trades table
+    bool sorted = false;
+    long sortMemoryMB = 256;     // in-memory budget before runs spill to disk
+    int threads = 0;             // worker threads, 0 = one per CPU
+
+    // Stage rows in per-thread in-memory databases, merged at the end
+    bool staging = false;
+
     // Validation methods
     bool hasRequiredArgs() const;
     bool hasType() const { return type.has_value(); }
@@ -25,4 +33,5 @@ private:
     void parse();
     void validateArgs() const;
     void parseArg(const std::string& arg, int& i);
+    static long parseCount(const std::string& option, const std::string& value, long min, long max);
 };
@@ -0,0 +1,58 @@
+//
+// Created by jesse on 10/25/24.
+//
+
+#include "csv_parser.h"
+#include <algorithm>
+
+namespace {
+std::string_view trimField(std::string_view field, char delimiter) {
+    if (delimiter == '\t') {
+        if (!field.empty() && field.back() == '\r') field.remove_suffix(1);
+        return field;
+    }
+    size_t first = field.find_first_not_of(" \t\r\n");
+    if (first == std::string_view::npos) return {};
+    size_t last = field.find_last_not_of(" \t\r\n");
+    return field.substr(first, last - first + 1);
+}
+}
+
+char CsvParser::detectDelimiter(std::string_view line) {
+    size_t commas = std::count(line.begin(), line.end(), ',');
+    size_t tabs = std::count(line.begin(), line.end(), '\t');
+    return (commas > tabs) ? ',' : '\t';
+}
+
+size_t CsvParser::splitView(std::string_view line, char delimiter,
+                            std::vector<std::string_view>& fields, size_t maxFields) {
+    fields.clear();
+    size_t start = 0;
+    while (start < line.size() && fields.size() < maxFields) {
+        size_t end = line.find(delimiter, start);
+        if (end == std::string_view::npos) end = line.size();
+        fields.push_back(trimField(line.substr(start, end - start), delimiter));
+        start = end + 1;
+    }
+    return fields.size();
+}
+
+size_t CsvParser::countFields(std::string_view line, char delimiter) {
+    if (line.empty()) return 0;
+    size_t delimiters = std::count(line.begin(), line.end(), delimiter);
+    return line.back() == delimiter ? delimiters : delimiters + 1;
+}
+
+std::vector<std::string> CsvParser::split(const std::string& line, char delimiter) {
+    std::vector<std::string_view> views;
+    splitView(line, delimiter, views);
+    return std::vector<std::string>(views.begin(), views.end());
+}
+
+void CsvParser::stripBom(std::vector<std::string>& headers) {
+    for (auto& header : headers) {
+        if (!header.empty() && (unsigned char)header[0] == 0xEF) {
+            header = header.substr(3);
+        }
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Line-level CSV parsing shared by DbProcessor and the csvtape virtual
+// table. Lines are split on a single delimiter without quoting; comma
+// fields are whitespace-trimmed, tab fields only lose a trailing '\r'. As
+// with std::getline, a trailing delimiter does not produce an empty field.
+class CsvParser {
+public:
+    static char detectDelimiter(std::string_view line);
+
+    static std::vector<std::string> split(const std::string& line, char delimiter = '\t');
+
+    // Non-allocating variant: fills `fields` with views into `line`, stopping
+    // after `maxFields`. Returns the number of fields produced.
+    static size_t splitView(std::string_view line, char delimiter,
+                            std::vector<std::string_view>& fields,
+                            size_t maxFields = SIZE_MAX);
+
+    // Number of fields split() would produce, without producing them.
+    static size_t countFields(std::string_view line, char delimiter);
+
+    // Drops a UTF-8 byte order mark from the first header.
+    static void stripBom(std::vector<std::string>& headers);
+};
@@ -0,0 +1,530 @@
+//
+// Created by jesse on 10/25/24.
+//
+// csvtape: loadable SQLite module exposing a raw trades CSV as a read-only
+// virtual table, parsed with the same CsvParser as csv_to_sqlite.
+//
+//   .load ./csvtape
+//   CREATE VIRTUAL TABLE tape USING csvtape('trades.csv');
+//   SELECT Time, Price, Qty FROM tape WHERE Time >= '10:00' AND Root = 'TSLA';
+//
+// The file is mmapped. Only the columns a query uses are converted, Time
+// range and Root equality constraints are pushed down (TEXT columns under the
+// BINARY collation only), and Time ranges are answered from a sparse
+// per-block min/max index persisted next to the file as <file>.tidx once the
+// first time-constrained query has built it.
+
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT1
+
+#include "csv_parser.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace {
+constexpr size_t kIndexStride = 1024;            // rows per index block
+constexpr uint32_t kIndexMagic = 0x58444954;     // "TIDX"
+constexpr uint32_t kIndexVersion = 1;
+
+// idxNum flags; the pushed-down arguments arrive in this order
+constexpr int kTimeLower = 1;
+constexpr int kTimeLowerStrict = 2;
+constexpr int kTimeUpper = 4;
+constexpr int kTimeUpperStrict = 8;
+constexpr int kTimeEq = 16;
+constexpr int kRootEq = 32;
+constexpr int kFieldShift = 8;                   // bits 8+: fields to split, 0 = all
+
+enum ColumnKind { kText, kInteger, kReal };
+
+struct IndexBlock {
+    uint64_t offset;
+    std::string minTime;
+    std::string maxTime;
+};
+
+struct TapeTable {
+    sqlite3_vtab base;                           // must stay first
+    std::string path;
+    const char* data = nullptr;
+    size_t size = 0;
+    int64_t mtimeNs = 0;
+    size_t bodyStart = 0;
+    std::vector<std::string> headers;
+    std::vector<ColumnKind> kinds;
+    int timeCol = -1;
+    int rootCol = -1;
+    bool indexReady = false;
+    std::vector<IndexBlock> index;
+};
+
+struct TapeCursor {
+    sqlite3_vtab_cursor base;                    // must stay first
+    TapeTable* table;
+    std::vector<std::pair<size_t, size_t>> ranges;   // byte ranges left to scan
+    size_t rangeIdx = 0;
+    size_t next = 0;
+    size_t rowStart = 0;
+    bool eof = true;
+    int flags = 0;
+    size_t maxFields = SIZE_MAX;
+    std::string lower, upper, root;
+    std::string_view line;
+    char delimiter = ',';
+    std::vector<std::string_view> fields;
+};
+
+bool isInteger(std::string_view s, int64_t& value) {
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+    return ec == std::errc() && end == s.data() + s.size() && !s.empty();
+}
+
+bool isReal(std::string_view s, double& value) {
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+    return ec == std::errc() && end == s.data() + s.size() && !s.empty();
+}
+
+std::string dequote(std::string value) {
+    size_t eq = value.find('=');
+    if (eq != std::string::npos && value.compare(0, eq, "filename") == 0) {
+        value = value.substr(eq + 1);
+    }
+    if (value.size() >= 2 && (value.front() == '\'' || value.front() == '"') && value.back() == value.front()) {
+        value = value.substr(1, value.size() - 2);
+    }
+    return value;
+}
+
+// Next line starting at `pos`, with `pos` advanced past its newline.
+std::string_view nextLine(const TapeTable* t, size_t& pos, size_t end) {
+    const char* start = t->data + pos;
+    const char* newline = static_cast<const char*>(memchr(start, '\n', end - pos));
+    size_t len = newline ? newline - start : end - pos;
+    pos += len + (newline ? 1 : 0);
+    return std::string_view(start, len);
+}
+
+// A data row DbProcessor would accept: non-empty with a full set of fields.
+bool acceptRow(const TapeTable* t, std::string_view line, char& delimiter) {
+    if (line.empty()) return false;
+    delimiter = CsvParser::detectDelimiter(line);
+    return CsvParser::countFields(line, delimiter) == t->headers.size();
+}
+
+std::string indexPath(const TapeTable* t) {
+    return t->path + ".tidx";
+}
+
+bool loadIndex(TapeTable* t) {
+    std::ifstream in(indexPath(t), std::ios::binary);
+    uint32_t magic, version, stride, timeCol;
+    uint64_t size, count;
+    int64_t mtime;
+    if (!in.read(reinterpret_cast<char*>(&magic), 4) || magic != kIndexMagic) return false;
+    in.read(reinterpret_cast<char*>(&version), 4);
+    in.read(reinterpret_cast<char*>(&size), 8);
+    in.read(reinterpret_cast<char*>(&mtime), 8);
+    in.read(reinterpret_cast<char*>(&stride), 4);
+    in.read(reinterpret_cast<char*>(&timeCol), 4);
+    in.read(reinterpret_cast<char*>(&count), 8);
+    if (!in || version != kIndexVersion || size != t->size || mtime != t->mtimeNs ||
+        stride != kIndexStride || static_cast<int>(timeCol) != t->timeCol) {
+        return false;   // stale: the CSV changed since the index was written
+    }
+    t->index.resize(count);
+    for (auto& block : t->index) {
+        uint16_t len;
+        in.read(reinterpret_cast<char*>(&block.offset), 8);
+        in.read(reinterpret_cast<char*>(&len), 2);
+        block.minTime.resize(len);
+        in.read(block.minTime.data(), len);
+        in.read(reinterpret_cast<char*>(&len), 2);
+        block.maxTime.resize(len);
+        in.read(block.maxTime.data(), len);
+    }
+    if (!in) t->index.clear();
+    return static_cast<bool>(in);
+}
+
+void saveIndex(const TapeTable* t) {
+    // Write-then-rename so readers never see a half-written index
+    std::string tmp = indexPath(t) + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) return;
+        uint32_t magic = kIndexMagic, version = kIndexVersion, stride = kIndexStride, timeCol = t->timeCol;
+        uint64_t size = t->size, count = t->index.size();
+        int64_t mtime = t->mtimeNs;
+        out.write(reinterpret_cast<const char*>(&magic), 4);
+        out.write(reinterpret_cast<const char*>(&version), 4);
+        out.write(reinterpret_cast<const char*>(&size), 8);
+        out.write(reinterpret_cast<const char*>(&mtime), 8);
+        out.write(reinterpret_cast<const char*>(&stride), 4);
+        out.write(reinterpret_cast<const char*>(&timeCol), 4);
+        out.write(reinterpret_cast<const char*>(&count), 8);
+        for (const auto& block : t->index) {
+            uint16_t minLen = block.minTime.size(), maxLen = block.maxTime.size();
+            out.write(reinterpret_cast<const char*>(&block.offset), 8);
+            out.write(reinterpret_cast<const char*>(&minLen), 2);
+            out.write(block.minTime.data(), minLen);
+            out.write(reinterpret_cast<const char*>(&maxLen), 2);
+            out.write(block.maxTime.data(), maxLen);
+        }
+        if (!out) {
+            unlink(tmp.c_str());
+            return;
+        }
+    }
+    rename(tmp.c_str(), indexPath(t).c_str());
+}
+
+void buildIndex(TapeTable* t) {
+    t->indexReady = true;
+    if (t->timeCol < 0 || loadIndex(t)) return;
+
+    std::vector<std::string_view> fields;
+    size_t pos = t->bodyStart;
+    size_t rows = 0;
+    while (pos < t->size) {
+        size_t rowStart = pos;
+        std::string_view line = nextLine(t, pos, t->size);
+        char delimiter;
+        if (!acceptRow(t, line, delimiter)) continue;
+        CsvParser::splitView(line, delimiter, fields, t->timeCol + 1);
+        std::string time(fields[t->timeCol].substr(0, UINT16_MAX));
+        if (rows % kIndexStride == 0) {
+            t->index.push_back({rowStart, time, time});
+        } else {
+            IndexBlock& block = t->index.back();
+            if (time < block.minTime) block.minTime = time;
+            if (time > block.maxTime) block.maxTime = time;
+        }
+        rows++;
+    }
+    saveIndex(t);
+}
+
+int tapeConnect(sqlite3* db, void*, int argc, const char* const* argv,
+                sqlite3_vtab** ppVtab, char** pzErr) {
+    if (argc < 4) {
+        *pzErr = sqlite3_mprintf("csvtape: usage csvtape('file.csv')");
+        return SQLITE_ERROR;
+    }
+    auto* t = new TapeTable();
+    t->path = dequote(argv[3]);
+
+    int fd = open(t->path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        if (fd >= 0) close(fd);
+        *pzErr = sqlite3_mprintf("csvtape: cannot open %s", t->path.c_str());
+        delete t;
+        return SQLITE_ERROR;
+    }
+    t->size = st.st_size;
+    t->mtimeNs = st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+    void* mapping = mmap(nullptr, t->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        *pzErr = sqlite3_mprintf("csvtape: cannot map %s", t->path.c_str());
+        delete t;
+        return SQLITE_ERROR;
+    }
+    t->data = static_cast<const char*>(mapping);
+
+    // Header, then infer column types from the first accepted data row
+    size_t pos = 0;
+    std::string_view header;
+    while (pos < t->size && header.empty()) header = nextLine(t, pos, t->size);
+    char delimiter = CsvParser::detectDelimiter(header);
+    t->headers = CsvParser::split(std::string(header), delimiter);
+    CsvParser::stripBom(t->headers);
+    t->bodyStart = pos;
+
+    t->kinds.assign(t->headers.size(), kText);
+    std::vector<std::string_view> fields;
+    while (pos < t->size) {
+        std::string_view line = nextLine(t, pos, t->size);
+        if (!acceptRow(t, line, delimiter)) continue;
+        CsvParser::splitView(line, delimiter, fields);
+        for (size_t i = 0; i < fields.size(); ++i) {
+            int64_t iv;
+            double dv;
+            t->kinds[i] = isInteger(fields[i], iv) ? kInteger : isReal(fields[i], dv) ? kReal : kText;
+        }
+        break;
+    }
+
+    std::string sql = "CREATE TABLE x(";
+    for (size_t i = 0; i < t->headers.size(); ++i) {
+        const std::string& name = t->headers[i];
+        if (name == "Time") t->timeCol = i;
+        if (name == "Root") t->rootCol = i;
+        std::string quoted;
+        for (char c : name) {
+            quoted += c;
+            if (c == '"') quoted += '"';
+        }
+        sql += (i ? ", \"" : "\"") + quoted + "\" " +
+               (t->kinds[i] == kInteger ? "INTEGER" : t->kinds[i] == kReal ? "REAL" : "TEXT");
+    }
+    sql += ")";
+
+    int rc = sqlite3_declare_vtab(db, sql.c_str());
+    if (rc != SQLITE_OK) {
+        *pzErr = sqlite3_mprintf("csvtape: bad header in %s", t->path.c_str());
+        munmap(const_cast<char*>(t->data), t->size);
+        delete t;
+        return rc;
+    }
+    *ppVtab = &t->base;
+    return SQLITE_OK;
+}
+
+int tapeDisconnect(sqlite3_vtab* vtab) {
+    auto* t = reinterpret_cast<TapeTable*>(vtab);
+    munmap(const_cast<char*>(t->data), t->size);
+    delete t;
+    return SQLITE_OK;
+}
+
+// Pruning compares raw field bytes, which only agrees with SQLite's own
+// comparison for a TEXT column under the BINARY collation: NOCASE would
+// match rows we skip, and numeric columns compare by value
+bool bytewise(const TapeTable* t, sqlite3_index_info* info, int i, int column) {
+    return column >= 0 && t->kinds[column] == kText &&
+           sqlite3_stricmp(sqlite3_vtab_collation(info, i), "BINARY") == 0;
+}
+
+int tapeBestIndex(sqlite3_vtab* vtab, sqlite3_index_info* info) {
+    auto* t = reinterpret_cast<TapeTable*>(vtab);
+    int lower = -1, upper = -1, eq = -1, root = -1;
+    int flags = 0;
+    for (int i = 0; i < info->nConstraint; ++i) {
+        const auto& c = info->aConstraint[i];
+        if (!c.usable) continue;
+        if (c.iColumn == t->timeCol && bytewise(t, info, i, t->timeCol)) {
+            if (c.op == SQLITE_INDEX_CONSTRAINT_EQ && eq < 0) {
+                eq = i;
+            } else if ((c.op == SQLITE_INDEX_CONSTRAINT_GT || c.op == SQLITE_INDEX_CONSTRAINT_GE) && lower < 0) {
+                lower = i;
+                flags |= kTimeLower | (c.op == SQLITE_INDEX_CONSTRAINT_GT ? kTimeLowerStrict : 0);
+            } else if ((c.op == SQLITE_INDEX_CONSTRAINT_LT || c.op == SQLITE_INDEX_CONSTRAINT_LE) && upper < 0) {
+                upper = i;
+                flags |= kTimeUpper | (c.op == SQLITE_INDEX_CONSTRAINT_LT ? kTimeUpperStrict : 0);
+            }
+        } else if (c.iColumn == t->rootCol && bytewise(t, info, i, t->rootCol) &&
+                   c.op == SQLITE_INDEX_CONSTRAINT_EQ && root < 0) {
+            root = i;
+            flags |= kRootEq;
+        }
+    }
+    if (eq >= 0) {
+        // Equality subsumes any range on the same column
+        flags = (flags & kRootEq) | kTimeEq;
+        lower = upper = -1;
+    }
+
+    // SQLite still re-checks every constraint (omit stays 0), so pushdown
+    // only ever prunes and never changes comparison semantics.
+    int arg = 1;
+    for (int i : {eq, lower, upper, root}) {
+        if (i >= 0) info->aConstraintUsage[i].argvIndex = arg++;
+    }
+
+    double rows = t->size / 128.0;
+    if (flags & kTimeEq) rows /= 1000;
+    else if ((flags & kTimeLower) && (flags & kTimeUpper)) rows /= 20;
+    else if (flags & (kTimeLower | kTimeUpper)) rows /= 3;
+    if (flags & kRootEq) rows /= 2;
+    info->estimatedRows = static_cast<sqlite3_int64>(rows) + 1;
+    info->estimatedCost = rows + 1;
+
+    // Column projection: split each line only as far as the last used column
+    size_t fieldsNeeded = 0;
+    if (!(info->colUsed & (1ull << 63))) {
+        for (int i = 0; i < 63; ++i) {
+            if (info->colUsed & (1ull << i)) fieldsNeeded = i + 1;
+        }
+        if (fieldsNeeded == 0) fieldsNeeded = 1;
+    }
+    info->idxNum = flags | static_cast<int>(fieldsNeeded << kFieldShift);
+    return SQLITE_OK;
+}
+
+int tapeOpen(sqlite3_vtab* vtab, sqlite3_vtab_cursor** ppCursor) {
+    auto* cursor = new TapeCursor();
+    cursor->table = reinterpret_cast<TapeTable*>(vtab);
+    *ppCursor = &cursor->base;
+    return SQLITE_OK;
+}
+
+int tapeClose(sqlite3_vtab_cursor* cur) {
+    delete reinterpret_cast<TapeCursor*>(cur);
+    return SQLITE_OK;
+}
+
+bool rowMatches(TapeCursor* c) {
+    const TapeTable* t = c->table;
+    if (c->flags & (kTimeLower | kTimeUpper | kTimeEq)) {
+        std::string_view time = c->fields[t->timeCol];
+        if (c->flags & kTimeEq) {
+            if (time != c->lower) return false;
+        }
+        if (c->flags & kTimeLower) {
+            int cmp = time.compare(c->lower);
+            if (cmp < 0 || (cmp == 0 && (c->flags & kTimeLowerStrict))) return false;
+        }
+        if (c->flags & kTimeUpper) {
+            int cmp = time.compare(c->upper);
+            if (cmp > 0 || (cmp == 0 && (c->flags & kTimeUpperStrict))) return false;
+        }
+    }
+    if ((c->flags & kRootEq) && c->fields[t->rootCol] != c->root) return false;
+    return true;
+}
+
+int tapeNext(sqlite3_vtab_cursor* cur) {
+    auto* c = reinterpret_cast<TapeCursor*>(cur);
+    const TapeTable* t = c->table;
+    while (c->rangeIdx < c->ranges.size()) {
+        size_t end = c->ranges[c->rangeIdx].second;
+        if (c->next >= end) {
+            if (++c->rangeIdx < c->ranges.size()) c->next = c->ranges[c->rangeIdx].first;
+            continue;
+        }
+        size_t rowStart = c->next;
+        std::string_view line = nextLine(t, c->next, end);
+        if (!acceptRow(t, line, c->delimiter)) continue;
+        CsvParser::splitView(line, c->delimiter, c->fields, c->maxFields);
+        if (!rowMatches(c)) continue;
+        c->rowStart = rowStart;
+        c->line = line;
+        return SQLITE_OK;
+    }
+    c->eof = true;
+    return SQLITE_OK;
+}
+
+int tapeFilter(sqlite3_vtab_cursor* cur, int idxNum, const char*, int argc, sqlite3_value** argv) {
+    auto* c = reinterpret_cast<TapeCursor*>(cur);
+    TapeTable* t = c->table;
+    c->flags = idxNum & ((1 << kFieldShift) - 1);
+    size_t fieldsNeeded = static_cast<size_t>(idxNum) >> kFieldShift;
+    c->maxFields = fieldsNeeded ? fieldsNeeded : SIZE_MAX;
+    if (c->flags & (kTimeLower | kTimeUpper | kTimeEq)) c->maxFields = std::max<size_t>(c->maxFields, t->timeCol + 1);
+    if (c->flags & kRootEq) c->maxFields = std::max<size_t>(c->maxFields, t->rootCol + 1);
+
+    auto text = [&](int i) {
+        const unsigned char* s = i < argc ? sqlite3_value_text(argv[i]) : nullptr;
+        return s ? std::string(reinterpret_cast<const char*>(s)) : std::string();
+    };
+    int arg = 0;
+    if (c->flags & kTimeEq) c->lower = c->upper = text(arg++);
+    if (c->flags & kTimeLower) c->lower = text(arg++);
+    if (c->flags & kTimeUpper) c->upper = text(arg++);
+    if (c->flags & kRootEq) c->root = text(arg++);
+
+    c->ranges.clear();
+    if (c->flags & (kTimeLower | kTimeUpper | kTimeEq)) {
+        if (!t->indexReady) buildIndex(t);
+        // Keep only blocks whose [min, max] Time can overlap the range
+        for (size_t i = 0; i < t->index.size(); ++i) {
+            const IndexBlock& b = t->index[i];
+            bool lowOk = !(c->flags & (kTimeLower | kTimeEq)) || b.maxTime >= c->lower;
+            bool highOk = !(c->flags & (kTimeUpper | kTimeEq)) || b.minTime <= c->upper;
+            if (!lowOk || !highOk) continue;
+            size_t end = i + 1 < t->index.size() ? t->index[i + 1].offset : t->size;
+            if (!c->ranges.empty() && c->ranges.back().second == b.offset) {
+                c->ranges.back().second = end;
+            } else {
+                c->ranges.emplace_back(b.offset, end);
+            }
+        }
+    } else {
+        c->ranges.emplace_back(t->bodyStart, t->size);
+    }
+
+    c->rangeIdx = 0;
+    c->next = c->ranges.empty() ? 0 : c->ranges[0].first;
+    c->eof = false;
+    return tapeNext(cur);
+}
+
+int tapeEof(sqlite3_vtab_cursor* cur) {
+    return reinterpret_cast<TapeCursor*>(cur)->eof;
+}
+
+int tapeColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int col) {
+    auto* c = reinterpret_cast<TapeCursor*>(cur);
+    if (static_cast<size_t>(col) >= c->fields.size()) {
+        // Not covered by the projection; split the rest of the row
+        CsvParser::splitView(c->line, c->delimiter, c->fields);
+        c->maxFields = SIZE_MAX;
+    }
+    std::string_view value = c->fields[col];
+    int64_t iv;
+    double dv;
+    switch (c->table->kinds[col]) {
+        case kInteger:
+        case kReal:
+            if (value.empty()) {
+                sqlite3_result_null(ctx);
+            } else if (isInteger(value, iv)) {
+                sqlite3_result_int64(ctx, iv);
+            } else if (isReal(value, dv)) {
+                sqlite3_result_double(ctx, dv);
+            } else {
+                sqlite3_result_text(ctx, value.data(), value.size(), SQLITE_TRANSIENT);
+            }
+            break;
+        default:
+            sqlite3_result_text(ctx, value.data(), value.size(), SQLITE_TRANSIENT);
+    }
+    return SQLITE_OK;
+}
+
+int tapeRowid(sqlite3_vtab_cursor* cur, sqlite3_int64* rowid) {
+    // Byte offset of the row in the file
+    *rowid = reinterpret_cast<TapeCursor*>(cur)->rowStart;
+    return SQLITE_OK;
+}
+
+// Value-initialized and filled by name: the struct grows with every SQLite
+// release, and iVersion 0 tells SQLite to ignore the members we leave null
+sqlite3_module makeTapeModule() {
+    sqlite3_module module = {};
+    module.iVersion = 0;
+    module.xCreate = tapeConnect;
+    module.xConnect = tapeConnect;
+    module.xBestIndex = tapeBestIndex;
+    module.xDisconnect = tapeDisconnect;
+    module.xDestroy = tapeDisconnect;
+    module.xOpen = tapeOpen;
+    module.xClose = tapeClose;
+    module.xFilter = tapeFilter;
+    module.xNext = tapeNext;
+    module.xEof = tapeEof;
+    module.xColumn = tapeColumn;
+    module.xRowid = tapeRowid;
+    return module;
+}
+
+const sqlite3_module tapeModule = makeTapeModule();
+}
+
+extern "C" int sqlite3_csvtape_init(sqlite3* db, char**, const sqlite3_api_routines* pApi) {
+    SQLITE_EXTENSION_INIT2(pApi);
+    return sqlite3_create_module(db, "csvtape", &tapeModule, nullptr);
+}
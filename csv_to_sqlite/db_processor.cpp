@@ -3,11 +3,17 @@
 //
 
 #include "db_processor.h"
+#include "csv_parser.h"
+#include "schema.h"
+#include "sorted_loader.h"
+#include "staged_loader.h"
+#include "telemetry.h"
 #include <sstream>
 #include <random>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
+#include <mutex>
 
 class DbProcessor::Impl {
 public:
@@ -20,9 +26,9 @@ public:
     }
 
     void process() {
+        telemetry_.setPhase("open");
         initializeDb();
         createTable();
-        //processInput();
         processInputFile();
     }
 
@@ -33,6 +39,10 @@ private:
     std::string year_, month_, day_;
     std::vector<std::string> headers_;
     int time_offset_ = 0;
+    Telemetry telemetry_;   // no-op unless started by runner
+    std::unique_ptr<SortedLoader> loader_;  // --sorted
+    std::unique_ptr<StagedLoader> stager_;  // --staging
+    std::mutex console_;
 
     void parseFileDate() {
         if (args_.hasDate()) {
@@ -49,9 +59,7 @@ private:
     }
 
     std::string formatDate() const {
-        std::stringstream date_str;
-        date_str << month_ << "-" << day_ << "-" << year_.substr(2);
-        return date_str.str();
+        return TradeSchema::storedDate(args_.date.value(), args_.sorted ? "trades" : "nodes");
     }
 
     std::string getTimestampFromField(const std::vector<std::string>& fields) {
@@ -64,7 +72,9 @@ private:
     }
 
     void initializeDb() {
-        int rc = sqlite3_open("trades.db", &db_);
+        // URI processing lets ATTACH name the shared-cache staging databases
+        int rc = sqlite3_open_v2("trades.db", &db_,
+                                 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI, nullptr);
         if (rc) {
             throw std::runtime_error("Cannot open database: " +
                 std::string(sqlite3_errmsg(db_)));
@@ -72,30 +82,19 @@ private:
     }
 
     void createTable() {
-        const char* create_table_sql =
-            "CREATE TABLE IF NOT EXISTS nodes ("
-            "    guid TEXT PRIMARY KEY,"
-            "    type TEXT NOT NULL,"
-            "    date TEXT NOT NULL,"
-            "    timestamp TEXT NOT NULL,"
-            "    expiry TEXT NOT NULL,"
-            "    body TEXT NOT NULL"
-            ");";
-
-        char* err_msg = nullptr;
-        int rc = sqlite3_exec(db_, create_table_sql, nullptr, nullptr, &err_msg);
-        if (rc != SQLITE_OK) {
-            std::string error = err_msg;
-            sqlite3_free(err_msg);
-            throw std::runtime_error("SQL error: " + error);
+        if (args_.sorted) {
+            TradeSchema::exec(db_, TradeSchema::kCreateTrades, "SQL error");
+            return;
         }
+        TradeSchema::exec(db_, TradeSchema::kCreateNodes, "SQL error");
     }
 
     std::string generateUuid() {
-        static std::random_device rd;
-        static std::mt19937 gen(rd());
-        static std::uniform_int_distribution<> dis(0, 15);
-        static std::uniform_int_distribution<> dis2(8, 11);
+        // Per thread: the staging threads generate ids concurrently
+        static thread_local std::random_device rd;
+        static thread_local std::mt19937 gen(rd());
+        static thread_local std::uniform_int_distribution<> dis(0, 15);
+        static thread_local std::uniform_int_distribution<> dis2(8, 11);
 
         std::stringstream ss;
         ss << std::hex;
@@ -114,28 +113,6 @@ private:
         return ss.str();
     }
 
-    std::vector<std::string> split(const std::string& line, char delimiter='\t') {
-        std::vector<std::string> tokens;
-        std::string token;
-        std::stringstream ss(line);
-
-        if (delimiter == '\t') {
-            while (std::getline(ss, token, delimiter)) {
-                if (!token.empty() && token.back() == '\r') {
-                    token.pop_back();
-                }
-                tokens.push_back(token);
-            }
-        } else {
-            while (std::getline(ss, token, ',')) {
-                token.erase(0, token.find_first_not_of(" \t\r\n"));
-                token.erase(token.find_last_not_of(" \t\r\n") + 1);
-                tokens.push_back(token);
-            }
-        }
-        return tokens;
-    }
-
     std::string createJsonBody(const std::vector<std::string>& fields) {
         std::stringstream json;
         json << "{";
@@ -157,151 +134,191 @@ private:
     }
 
     void beginTransaction() {
-        char* err_msg = nullptr;
-        int rc = sqlite3_exec(db_, "BEGIN TRANSACTION;", nullptr, nullptr, &err_msg);
-        if (rc != SQLITE_OK) {
-            std::string error = err_msg;
-            sqlite3_free(err_msg);
-            throw std::runtime_error("Failed to begin transaction: " + error);
-        }
+        TradeSchema::exec(db_, "BEGIN TRANSACTION;", "Failed to begin transaction");
     }
 
     void prepareStatement() {
-        const char* insert_sql =
-            "INSERT INTO nodes (guid, type, date, timestamp, expiry, body) "
-            "VALUES (?, ?, ?, ?, ?, ?);";
-
-        int rc = sqlite3_prepare_v2(db_, insert_sql, -1, &stmt_, nullptr);
+        int rc = sqlite3_prepare_v2(db_, TradeSchema::kInsertNode, -1, &stmt_, nullptr);
         if (rc != SQLITE_OK) {
             throw std::runtime_error("Failed to prepare statement: " +
                 std::string(sqlite3_errmsg(db_)));
         }
     }
 
-    char detectDelimiter(const std::string& line) {
-        size_t commas = std::count(line.begin(), line.end(), ',');
-        size_t tabs = std::count(line.begin(), line.end(), '\t');
-        return (commas > tabs) ? ',' : '\t';
-    }
-
-    void processInput() {
-        beginTransaction();
-        prepareStatement();
-
-        std::string line;
-        bool isHeader = true;
-
-        while (std::getline(std::cin, line)) {
-            std::vector<std::string> fields = split(line);
-
-            if (isHeader) {
-                headers_ = fields;
-                isHeader = false;
-                continue;
-            }
-
-            processRow(fields);
+    void processInputFile() {
+        if (args_.inputFileName == "-") {
+            // Streamed from stdin (e.g. runner --stdin), same parser as a file
+            std::ios::sync_with_stdio(false);
+            processStream(std::cin);
+            return;
         }
 
-        commitTransaction();
-    }
-
-    void processInputFile() {
         // Open and read the entire file
         std::ifstream file(args_.inputFileName);
         if (!file.is_open()) {
             throw std::runtime_error("Failed to open input file: " + args_.inputFileName);
         }
 
-        // Process the content
+        processStream(file);
+        file.close();
+    }
+
+    void processStream(std::istream& in) {
+        // Stages are attached before the transaction; ATTACH is not allowed inside one
+        if (args_.staging) {
+            stager_ = std::make_unique<StagedLoader>(db_, args_.threads,
+                [this](const std::string& line, TradeRecord& record) {
+                    std::vector<std::string> fields = CsvParser::split(line, CsvParser::detectDelimiter(line));
+                    telemetry_.add(kRowsParsed);
+                    return buildRecord(fields, record);
+                }, telemetry_);
+        }
+
+        // Process the content. BEGIN is deferred, so sorted and staged loads
+        // take the write lock only once their merge starts inserting.
         beginTransaction();
-        prepareStatement();
+        if (args_.sorted) {
+            loader_ = std::make_unique<SortedLoader>(args_.sortMemoryMB << 20, args_.threads, telemetry_);
+        } else if (!stager_) {
+            prepareStatement();
+        }
+        telemetry_.setPhase("load");
 
         std::string line;
         bool isHeader = true;
         char delimiter = ',';
 
-        while (std::getline(file, line)) {
+        while (std::getline(in, line)) {
+            telemetry_.add(kBytesConsumed, line.size() + 1);
             if (line.empty()) continue;  // Skip empty lines
 
             if (isHeader) {
-                delimiter = detectDelimiter(line);
-                headers_ = split(line, delimiter);
-
-                for (auto& header : headers_) {
-                    if (!header.empty() && (unsigned char)header[0] == 0xEF) {
-                        header = header.substr(3);
-                    }
-                }
+                delimiter = CsvParser::detectDelimiter(line);
+                headers_ = CsvParser::split(line, delimiter);
+                CsvParser::stripBom(headers_);
                 isHeader = false;
                 continue;
             }
-            delimiter = detectDelimiter(line);
-            std::vector<std::string> fields = split(line, delimiter);
+            if (stager_) {
+                // Parsed and built on the staging threads
+                stager_->add(std::move(line));
+                continue;
+            }
+            delimiter = CsvParser::detectDelimiter(line);
+            std::vector<std::string> fields = CsvParser::split(line, delimiter);
+            telemetry_.add(kRowsParsed);
             processRow(fields);
         }
 
+        if (loader_) {
+            loader_->finish(db_);
+            std::cout << "Sorted load: " << loader_->runs() << " runs, "
+                      << loader_->spilledRuns() << " spilled to disk\n";
+            loader_.reset();
+        }
+        if (stager_) {
+            size_t merged = stager_->finish();
+            std::cout << "Staged load: " << merged << " rows merged from "
+                      << stager_->stages() << " stages\n";
+        }
+
+        if (!args_.sorted) {
+            // Built once over the loaded rows rather than maintained per insert.
+            // If it already exists from an earlier load, the inserts kept it current.
+            telemetry_.setPhase("index");
+            TradeSchema::exec(db_, TradeSchema::kCreateScanIndex, "SQL error");
+        }
+
+        telemetry_.setPhase("commit");
         commitTransaction();
-        file.close();
+        stager_.reset();
+        telemetry_.setPhase("done");
     }
 
     void processRow(const std::vector<std::string>& fields) {
 
         std::cout << "Processing row with " << fields.size() << " fields\n";
 
+        TradeRecord record;
+        if (!buildRecord(fields, record)) return;
+
+        if (loader_) {
+            // Inserted, and counted, when the sorted runs are merged
+            loader_->add(std::move(record));
+            return;
+        }
+
+        try {
+            std::cout << "Inserting record: " << record.guid << ", " << record.type << ", "
+                     << record.date << ", " << record.timestamp << ", " << record.expiry << "\n";
+
+            insertRecord(record.guid, record.type, record.date, record.timestamp,
+                         record.expiry, record.body);
+            telemetry_.add(kRowsInserted);
+        } catch (const std::exception& e) {
+            std::cerr << "Error processing row: " << e.what() << "\n";
+            telemetry_.add(kRowsRejected);
+        }
+
+    }
+
+    // Fields to a record, or false (reported and counted) for a rejected row.
+    // Runs on the staging threads too, so console output is serialized.
+    bool buildRecord(const std::vector<std::string>& fields, TradeRecord& record) {
         if (fields.size() != headers_.size()) {
+            std::lock_guard<std::mutex> lock(console_);
             std::cerr << "Mismatch in field count. Expected " << headers_.size()
                      << ", got " << fields.size() << ". Skipping line.\n";
             for (const auto& field : fields) {
                 std::cerr << field << "|";
             }
             std::cerr << "\n";
-            return;
+            telemetry_.add(kRowsRejected);
+            return false;
         }
 
         try {
             // Generate UUID
-            std::string guid = generateUuid();
+            record.guid = generateUuid();
 
             // Determine type
-            std::string type;
+            record.type.clear();
             if (args_.hasType()) {
-                type = args_.type.value();
+                record.type = args_.type.value();
             } else {
                 for (size_t i = 0; i < headers_.size(); ++i) {
                     if (headers_[i] == "Root") {
-                        type = fields[i];
+                        record.type = fields[i];
                         break;
                     }
                 }
             }
-            if (type.empty()) {
+            if (record.type.empty()) {
+                std::lock_guard<std::mutex> lock(console_);
                 std::cerr << "Warning: Type not found, using default\n";
-                type = "DEFAULT";
+                record.type = "DEFAULT";
             }
 
             // Format time
-            std::string date = formatDate();
+            record.date = formatDate();
 
-            std::string timestamp = getTimestampFromField(fields);
-            if (timestamp.empty()) {
+            record.timestamp = getTimestampFromField(fields);
+            if (record.timestamp.empty()) {
                 throw std::runtime_error("Time column not found in CSV");
             }
 
             // Get expiry
-            std::string expiry = getExpiryFromFields(fields);
+            record.expiry = getExpiryFromFields(fields);
 
             // Create JSON body
-            std::string body = createJsonBody(fields);
-
-            std::cout << "Inserting record: " << guid << ", " << type << ", "
-                     << date << ", " << timestamp << ", " << expiry << "\n";
-
-            insertRecord(guid, type, date, timestamp, expiry, body);
+            record.body = createJsonBody(fields);
+            return true;
         } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(console_);
             std::cerr << "Error processing row: " << e.what() << "\n";
+            telemetry_.add(kRowsRejected);
+            return false;
         }
-
     }
 
     std::string getTypeFromFields(const std::vector<std::string>& fields) {
@@ -408,16 +425,13 @@ private:
     }
 
     void commitTransaction() {
-        char* err_msg = nullptr;
-        int rc = sqlite3_exec(db_, "COMMIT;", nullptr, nullptr, &err_msg);
-        if (rc != SQLITE_OK) {
-            std::string error = err_msg;
-            sqlite3_free(err_msg);
-            throw std::runtime_error("Failed to commit transaction: " + error);
-        }
+        TradeSchema::exec(db_, "COMMIT;", "Failed to commit transaction");
     }
 
     void cleanup() {
+        // Both may still reference db_ after a failed load
+        loader_.reset();
+        stager_.reset();
         if (stmt_) {
             sqlite3_finalize(stmt_);
             stmt_ = nullptr;
@@ -0,0 +1,211 @@
+//
+// Created by jesse on 10/25/24.
+//
+
+#include "sorted_loader.h"
+#include "schema.h"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+constexpr size_t kMinRunBytes = 1 << 20;
+constexpr size_t kSpillBuffer = 1 << 20;
+
+void writeField(FILE* file, const std::string& value) {
+    uint32_t length = value.size();
+    if (fwrite(&length, sizeof(length), 1, file) != 1 ||
+        fwrite(value.data(), 1, length, file) != length) {
+        throw std::runtime_error("Failed to write sort run");
+    }
+}
+
+bool readField(FILE* file, std::string& value) {
+    uint32_t length;
+    if (fread(&length, sizeof(length), 1, file) != 1) return false;
+    value.resize(length);
+    return fread(value.data(), 1, length, file) == length;
+}
+}
+
+// Walks one sorted run, in memory or read back from its spill file.
+class SortedLoader::Cursor {
+public:
+    explicit Cursor(Run& run) : run_(run) {
+        if (run_.file) rewind(run_.file);
+        advance();
+    }
+
+    bool valid() const { return head_ != nullptr; }
+    const TradeRecord& head() const { return *head_; }
+
+    void advance() {
+        if (!run_.file) {
+            head_ = next_ < run_.records.size() ? &run_.records[next_++] : nullptr;
+            return;
+        }
+        TradeRecord& r = spilled_;
+        bool ok = readField(run_.file, r.type) && readField(run_.file, r.date) &&
+                  readField(run_.file, r.timestamp) && readField(run_.file, r.guid) &&
+                  readField(run_.file, r.expiry) && readField(run_.file, r.body);
+        if (!ok && ferror(run_.file)) {
+            throw std::runtime_error("Failed to read sort run");
+        }
+        head_ = ok ? &spilled_ : nullptr;
+    }
+
+private:
+    Run& run_;
+    size_t next_ = 0;
+    TradeRecord spilled_;
+    const TradeRecord* head_ = nullptr;
+};
+
+SortedLoader::SortedLoader(size_t memoryBudget, int threads, Telemetry& telemetry)
+    : memoryBudget_(memoryBudget),
+      threads_(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency())),
+      telemetry_(telemetry) {
+    // Half the budget holds finished runs; the other half is split between
+    // the run being filled and the ones being sorted
+    runBytes_ = std::max(kMinRunBytes, memoryBudget_ / 2 / (threads_ + 1));
+}
+
+SortedLoader::~SortedLoader() {
+    for (auto& future : pending_) {
+        try {
+            runs_.push_back(future.get());
+        } catch (const std::exception&) {
+            // Already reported through the failing get() in finish()
+        }
+    }
+    for (auto& run : runs_) {
+        if (run.file) fclose(run.file);
+    }
+}
+
+void SortedLoader::add(TradeRecord record) {
+    currentBytes_ += record.bytes();
+    current_.push_back(std::move(record));
+    if (currentBytes_ >= runBytes_) {
+        dispatch();
+    }
+}
+
+void SortedLoader::dispatch() {
+    if (current_.empty()) return;
+    // At most one sort in flight per thread
+    collect(threads_ - 1);
+
+    bool spill = keptBytes_ + currentBytes_ > memoryBudget_ / 2;
+    if (!spill) keptBytes_ += currentBytes_;
+    pending_.push_back(std::async(std::launch::async, sortRun, std::move(current_), spill));
+    current_ = {};
+    currentBytes_ = 0;
+}
+
+void SortedLoader::collect(size_t keep) {
+    while (pending_.size() > keep) {
+        Run run = pending_.front().get();
+        pending_.erase(pending_.begin());
+        if (run.file) {
+            telemetry_.event(kEventMessage, run.bytes, "sort run spilled");
+        }
+        runs_.push_back(std::move(run));
+    }
+}
+
+SortedLoader::Run SortedLoader::sortRun(std::vector<TradeRecord> records, bool spill) {
+    std::sort(records.begin(), records.end());
+    Run run;
+    for (const auto& record : records) {
+        run.bytes += record.bytes();
+    }
+    if (!spill) {
+        run.records = std::move(records);
+        return run;
+    }
+
+    run.file = spillFile();
+    for (const auto& record : records) {
+        writeField(run.file, record.type);
+        writeField(run.file, record.date);
+        writeField(run.file, record.timestamp);
+        writeField(run.file, record.guid);
+        writeField(run.file, record.expiry);
+        writeField(run.file, record.body);
+    }
+    if (fflush(run.file) != 0) {
+        throw std::runtime_error("Failed to write sort run");
+    }
+    return run;
+}
+
+FILE* SortedLoader::spillFile() {
+    std::string path = (std::filesystem::temp_directory_path() / "csv_to_sqlite-run-XXXXXX").string();
+    int fd = mkstemp(path.data());
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create sort run file in " + path);
+    }
+    // Unlinked right away: the space is returned on close, even after a crash
+    unlink(path.c_str());
+    FILE* file = fdopen(fd, "w+b");
+    if (!file) {
+        close(fd);
+        throw std::runtime_error("Failed to open sort run file");
+    }
+    setvbuf(file, nullptr, _IOFBF, kSpillBuffer);
+    return file;
+}
+
+size_t SortedLoader::spilledRuns() const {
+    return std::count_if(runs_.begin(), runs_.end(), [](const Run& run) { return run.file != nullptr; });
+}
+
+size_t SortedLoader::runs() const {
+    return runs_.size();
+}
+
+void SortedLoader::finish(sqlite3* db) {
+    dispatch();
+    collect(0);
+    telemetry_.setPhase("merge");
+
+    std::vector<std::unique_ptr<Cursor>> cursors;
+    auto later = [](const Cursor* a, const Cursor* b) { return b->head() < a->head(); };
+    std::priority_queue<Cursor*, std::vector<Cursor*>, decltype(later)> heap(later);
+    for (auto& run : runs_) {
+        cursors.push_back(std::make_unique<Cursor>(run));
+        if (cursors.back()->valid()) heap.push(cursors.back().get());
+    }
+
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, TradeSchema::kInsertTrade, -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db)));
+    }
+    while (!heap.empty()) {
+        Cursor* cursor = heap.top();
+        heap.pop();
+        const TradeRecord& r = cursor->head();
+        sqlite3_bind_text(stmt, 1, r.type.data(), r.type.size(), SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, r.date.data(), r.date.size(), SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, r.timestamp.data(), r.timestamp.size(), SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 4, r.guid.data(), r.guid.size(), SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 5, r.expiry.data(), r.expiry.size(), SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 6, r.body.data(), r.body.size(), SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::string error = sqlite3_errmsg(db);
+            sqlite3_finalize(stmt);
+            throw std::runtime_error("Failed to insert record: " + error);
+        }
+        sqlite3_reset(stmt);
+        telemetry_.add(kRowsInserted);
+
+        cursor->advance();
+        if (cursor->valid()) heap.push(cursor);
+    }
+    sqlite3_finalize(stmt);
+}
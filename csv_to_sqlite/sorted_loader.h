@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+#include "telemetry.h"
+#include "trade_record.h"
+
+// External sort for csv_to_sqlite --sorted. Rows are cut into runs that
+// worker threads sort in parallel; runs stay in memory while they fit the
+// budget and are spilled to unlinked temp files beyond it. finish() k-way
+// merges the runs into the WITHOUT ROWID trades table, so every insert lands
+// at the right edge of the B-tree.
+class SortedLoader {
+public:
+    SortedLoader(size_t memoryBudget, int threads, Telemetry& telemetry);
+    ~SortedLoader();
+
+    void add(TradeRecord record);
+    // Inserts everything into trades; the caller owns the transaction.
+    void finish(sqlite3* db);
+
+    size_t runs() const;
+    size_t spilledRuns() const;
+
+private:
+    struct Run {
+        std::vector<TradeRecord> records;   // when kept in memory
+        FILE* file = nullptr;               // when spilled
+        size_t bytes = 0;
+    };
+    class Cursor;
+
+    size_t memoryBudget_;
+    size_t runBytes_;
+    int threads_;
+    Telemetry& telemetry_;
+
+    std::vector<TradeRecord> current_;
+    size_t currentBytes_ = 0;
+    size_t keptBytes_ = 0;                  // in-memory runs, sorted or in flight
+    std::vector<std::future<Run>> pending_;
+    std::vector<Run> runs_;
+
+    void dispatch();
+    void collect(size_t keep);
+    static Run sortRun(std::vector<TradeRecord> records, bool spill);
+    static FILE* spillFile();
+};
@@ -0,0 +1,186 @@
+//
+// Created by jesse on 10/25/24.
+//
+
+#include "staged_loader.h"
+#include "schema.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+constexpr size_t kBatchLines = 1024;
+constexpr size_t kQueuedPerThread = 4;
+}
+
+StagedLoader::StagedLoader(sqlite3* target, int threads, RowBuilder build, Telemetry& telemetry)
+    : target_(target), build_(std::move(build)), telemetry_(telemetry) {
+    int count = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    // Every stage is ATTACHed to target, and SQLite caps that (10 by default)
+    count = std::min(count, std::max(1, sqlite3_limit(target_, SQLITE_LIMIT_ATTACHED, -1)));
+    maxQueued_ = count * kQueuedPerThread;
+
+    // The destructor does not run for a throwing constructor: undo whatever
+    // was set up so far (threads, ATTACHes, connections) before rethrowing
+    try {
+        open(count);
+    } catch (...) {
+        release();
+        throw;
+    }
+}
+
+StagedLoader::~StagedLoader() {
+    release();
+}
+
+void StagedLoader::open(int count) {
+    for (int i = 0; i < count; ++i) {
+        auto stage = std::make_unique<Stage>();
+        stage->name = "stage" + std::to_string(i);
+        // The in-memory database lives as long as this connection is open
+        std::string uri = "file:" + stage->name + "?mode=memory&cache=shared";
+        int rc = sqlite3_open_v2(uri.c_str(), &stage->db,
+                                 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI, nullptr);
+        stages_.push_back(std::move(stage));
+        if (rc != SQLITE_OK) {
+            throw std::runtime_error("Cannot open staging database: " +
+                                     std::string(sqlite3_errmsg(stages_.back()->db)));
+        }
+        TradeSchema::exec(stages_.back()->db, TradeSchema::kCreateNodes, "SQL error");
+    }
+
+    // ATTACH is not allowed inside a transaction, so it happens up front
+    for (const auto& stage : stages_) {
+        std::string sql = "ATTACH 'file:" + stage->name + "?mode=memory&cache=shared' AS " + stage->name + ";";
+        TradeSchema::exec(target_, sql.c_str(), "Cannot attach staging database");
+        ++attached_;
+    }
+
+    for (auto& stage : stages_) {
+        Stage* s = stage.get();
+        s->thread = std::thread([this, s] { work(*s); });
+    }
+}
+
+void StagedLoader::release() {
+    close();
+    for (auto& stage : stages_) {
+        if (stage->thread.joinable()) stage->thread.join();
+    }
+    detach();
+    for (auto& stage : stages_) {
+        sqlite3_close(stage->db);
+        stage->db = nullptr;
+    }
+}
+
+void StagedLoader::add(std::string line) {
+    current_.push_back(std::move(line));
+    if (current_.size() == kBatchLines) {
+        push(std::move(current_));
+        current_ = {};
+    }
+}
+
+void StagedLoader::push(Batch batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notFull_.wait(lock, [this] { return queue_.size() < maxQueued_; });
+    queue_.push_back(std::move(batch));
+    notEmpty_.notify_one();
+}
+
+bool StagedLoader::pop(Batch& batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notEmpty_.wait(lock, [this] { return !queue_.empty() || closed_; });
+    if (queue_.empty()) return false;
+    batch = std::move(queue_.front());
+    queue_.pop_front();
+    notFull_.notify_one();
+    return true;
+}
+
+void StagedLoader::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    notEmpty_.notify_all();
+}
+
+void StagedLoader::work(Stage& stage) {
+    sqlite3_stmt* stmt = nullptr;
+    try {
+        TradeSchema::exec(stage.db, "BEGIN TRANSACTION;", "Failed to begin transaction");
+        if (sqlite3_prepare_v2(stage.db, TradeSchema::kInsertNode, -1, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(stage.db)));
+        }
+
+        Batch batch;
+        TradeRecord r;
+        while (pop(batch)) {
+            for (const auto& line : batch) {
+                if (!build_(line, r)) continue;
+                sqlite3_bind_text(stmt, 1, r.guid.data(), r.guid.size(), SQLITE_STATIC);
+                sqlite3_bind_text(stmt, 2, r.type.data(), r.type.size(), SQLITE_STATIC);
+                sqlite3_bind_text(stmt, 3, r.date.data(), r.date.size(), SQLITE_STATIC);
+                sqlite3_bind_text(stmt, 4, r.timestamp.data(), r.timestamp.size(), SQLITE_STATIC);
+                sqlite3_bind_text(stmt, 5, r.expiry.data(), r.expiry.size(), SQLITE_STATIC);
+                sqlite3_bind_text(stmt, 6, r.body.data(), r.body.size(), SQLITE_STATIC);
+                if (sqlite3_step(stmt) != SQLITE_DONE) {
+                    throw std::runtime_error("Failed to stage record: " + std::string(sqlite3_errmsg(stage.db)));
+                }
+                sqlite3_reset(stmt);
+                ++stage.rows;
+            }
+        }
+
+        sqlite3_finalize(stmt);
+        stmt = nullptr;
+        TradeSchema::exec(stage.db, "COMMIT;", "Failed to commit staging transaction");
+    } catch (...) {
+        stage.error = std::current_exception();
+        if (stmt) sqlite3_finalize(stmt);
+        // Keep draining so the producer never blocks on a full queue
+        Batch batch;
+        while (pop(batch)) {}
+    }
+}
+
+size_t StagedLoader::finish() {
+    if (!current_.empty()) {
+        push(std::move(current_));
+        current_ = {};
+    }
+    close();
+    for (auto& stage : stages_) {
+        stage->thread.join();
+    }
+    for (auto& stage : stages_) {
+        if (stage->error) std::rethrow_exception(stage->error);
+    }
+
+    telemetry_.setPhase("merge");
+    size_t merged = 0;
+    for (const auto& stage : stages_) {
+        std::string sql = "INSERT INTO main.nodes (guid, type, date, timestamp, expiry, body) "
+                          "SELECT guid, type, date, timestamp, expiry, body FROM " + stage->name + ".nodes;";
+        TradeSchema::exec(target_, sql.c_str(), "Failed to merge " + stage->name);
+        size_t changes = sqlite3_changes64(target_);
+        if (changes != stage->rows) {
+            throw std::runtime_error("Merge of " + stage->name + " copied " + std::to_string(changes) +
+                                     " of " + std::to_string(stage->rows) + " rows");
+        }
+        telemetry_.add(kRowsInserted, changes);
+        merged += changes;
+    }
+    return merged;
+}
+
+void StagedLoader::detach() {
+    // Only possible outside a transaction; after a failure the caller's
+    // connection is closed instead, which detaches as well
+    if (attached_ == 0 || !sqlite3_get_autocommit(target_)) return;
+    for (size_t i = 0; i < attached_; ++i) {
+        std::string sql = "DETACH " + stages_[i]->name + ";";
+        sqlite3_exec(target_, sql.c_str(), nullptr, nullptr, nullptr);
+    }
+    attached_ = 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sqlite3.h>
+#include "telemetry.h"
+#include "trade_record.h"
+
+// csv_to_sqlite --staging. Worker threads each build rows into their own
+// shared-cache in-memory database (file:stageN?mode=memory&cache=shared).
+// finish() copies every stage into the target with INSERT ... SELECT over
+// ATTACH, so the target's write lock is taken only for that copy instead of
+// the whole load. Memory is not bounded: every row stays in a stage until
+// finish(). The stage count is capped at SQLITE_LIMIT_ATTACHED.
+class StagedLoader {
+public:
+    // Turns one CSV line into a record; false when the row is rejected.
+    // Called concurrently from the worker threads.
+    using RowBuilder = std::function<bool(const std::string& line, TradeRecord& record)>;
+
+    // Opens the stages and attaches them to target, which must not be in a
+    // transaction yet.
+    StagedLoader(sqlite3* target, int threads, RowBuilder build, Telemetry& telemetry);
+    ~StagedLoader();
+
+    void add(std::string line);
+    // Waits for the workers, then merges inside the caller's transaction.
+    // Returns the number of rows merged.
+    size_t finish();
+
+    size_t stages() const { return stages_.size(); }
+
+private:
+    using Batch = std::vector<std::string>;
+
+    struct Stage {
+        std::string name;
+        sqlite3* db = nullptr;
+        std::thread thread;
+        size_t rows = 0;
+        std::exception_ptr error;
+    };
+
+    sqlite3* target_;
+    RowBuilder build_;
+    Telemetry& telemetry_;
+    std::vector<std::unique_ptr<Stage>> stages_;
+    size_t attached_ = 0;       // stages ATTACHed to target_, in order
+
+    // Bounded queue of line batches, shared by all workers
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::deque<Batch> queue_;
+    size_t maxQueued_;
+    bool closed_ = false;
+    Batch current_;
+
+    void open(int count);
+    void release();
+    void push(Batch batch);
+    bool pop(Batch& batch);
+    void close();
+    void work(Stage& stage);
+    void detach();
+};
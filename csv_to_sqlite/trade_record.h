@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+#include <tuple>
+
+// One parsed CSV row on its way into the database. Ordered by the trades
+// table's primary key, whose date is YYYYMMDD.
+struct TradeRecord {
+    std::string type;
+    std::string date;
+    std::string timestamp;
+    std::string guid;
+    std::string expiry;
+    std::string body;
+
+    bool operator<(const TradeRecord& other) const {
+        return std::tie(type, date, timestamp, guid) <
+               std::tie(other.type, other.date, other.timestamp, other.guid);
+    }
+
+    size_t bytes() const {
+        return sizeof(TradeRecord) + type.size() + date.size() + timestamp.size() +
+               guid.size() + expiry.size() + body.size();
+    }
+};
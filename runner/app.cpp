@@ -3,6 +3,11 @@
 //
 
 #include "app.h"
+#include "feeder.h"
+#include "job_limits.h"
+#include "perf.h"
+#include "progress.h"
+#include "sampler.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -13,30 +18,112 @@
 #include <sys/resource.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <csignal>
+#include <cerrno>
+#include <spawn.h>
+#include <ctime>
+
+namespace {
+// Earliest of two select() timeouts where -1 means none
+int earliest(int a, int b) {
+    if (a < 0) return b;
+    if (b < 0) return a;
+    return std::min(a, b);
+}
+}
 
 App::App(const Args& args, Log& log) : args(args), log(log) {}
 
+pid_t App::spawn(std::vector<char*>& execArgs, int stdout_pipe[2], int stderr_pipe[2], int stdinFd,
+                 int telemetryFd) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, stdout_pipe[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, stderr_pipe[1], STDERR_FILENO);
+    posix_spawn_file_actions_addclose(&actions, stdout_pipe[0]);
+    posix_spawn_file_actions_addclose(&actions, stdout_pipe[1]);
+    posix_spawn_file_actions_addclose(&actions, stderr_pipe[0]);
+    posix_spawn_file_actions_addclose(&actions, stderr_pipe[1]);
+    if (stdinFd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, stdinFd, STDIN_FILENO);
+    } else {
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    }
+    if (telemetryFd >= 0) {
+        // dup2 onto itself clears FD_CLOEXEC in the child only (glibc 2.29+)
+        posix_spawn_file_actions_adddup2(&actions, telemetryFd, telemetryFd);
+    }
+
+    pid_t pid;
+    int rc = posix_spawnp(&pid, execArgs[0], &actions, NULL, execArgs.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) {
+        errno = rc;
+        return -1;
+    }
+    return pid;
+}
+
 void App::run() {
     // Open output file
     std::ofstream outputFile(args.outputFileName);
     if (!outputFile.is_open()) {
-        std::cerr << "Error: Cannot open output file\n";
-        exit(1);
+        throw std::runtime_error("Error: Cannot open output file");
     }
 
+    Limits limits(args, log);
+    limits.prepare();
+    Sampler sampler(args, log);
+    PerfCounters perf(args, log);
+    perf.prepare();
+    StdinFeeder feeder(args, log);
+    feeder.prepare();
+    Progress progress(args, log);
+    progress.prepare();
+
     // Create pipes for stdout and stderr
     int stdout_pipe[2];
     int stderr_pipe[2];
 
-    if (pipe(stdout_pipe) != 0 || pipe(stderr_pipe) != 0) {
-        std::cerr << "Error: Pipe creation failed\n";
-        exit(1);
+    if (pipe2(stdout_pipe, O_CLOEXEC) != 0) {
+        throw std::runtime_error("Error: Pipe creation failed");
+    }
+    if (pipe2(stderr_pipe, O_CLOEXEC) != 0) {
+        close(stdout_pipe[0]);
+        close(stdout_pipe[1]);
+        throw std::runtime_error("Error: Pipe creation failed");
+    }
+    // Errors after this point must not leak the pipes into a daemon worker
+    auto closePipes = [&]() {
+        for (int fd : {stdout_pipe[0], stdout_pipe[1], stderr_pipe[0], stderr_pipe[1]}) {
+            if (fd >= 0) close(fd);
+        }
+    };
+
+    // Prepare arguments for execvp
+    std::vector<char*> execArgs;
+    execArgs.push_back(const_cast<char*>(args.executableName.c_str()));
+    for (auto& arg : args.executableArgs) {
+        execArgs.push_back(const_cast<char*>(arg.c_str()));
     }
+    execArgs.push_back(NULL);
 
-    pid_t pid = fork();
+    // fork() only when something has to run between fork and exec (rlimits,
+    // cgroup join); otherwise posix_spawn's vfork-style clone avoids copying
+    // our page tables. Perf counters need neither, they are inherited.
+    struct timespec startTime;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+
+    pid_t pid;
+    if (limits.needsChildHook()) {
+        pid = fork();
+    } else {
+        pid = spawn(execArgs, stdout_pipe, stderr_pipe, feeder.childFd(), progress.childFd());
+    }
     if (pid < 0) {
-        std::cerr << "Error: Fork failed\n";
-        exit(1);
+        std::string reason = strerror(errno);
+        closePipes();
+        throw std::runtime_error("Error: Cannot start " + args.executableName + ": " + reason);
     } else if (pid == 0) {
         // Child process
         // Redirect stdout
@@ -49,66 +136,106 @@ void App::run() {
         close(stderr_pipe[0]);
         close(stderr_pipe[1]);
 
-        // Close unnecessary file descriptors
-        // Close stdin if you want to prevent child from reading from it
-        // Alternatively, you can redirect stdin to /dev/null
-        int devnull = open("/dev/null", O_RDONLY);
-        dup2(devnull, STDIN_FILENO);
-        close(devnull);
-
-        // Prepare arguments for execvp
-        std::vector<char*> execArgs;
-        execArgs.push_back(const_cast<char*>(args.executableName.c_str()));
-        for (auto& arg : args.executableArgs) {
-            execArgs.push_back(const_cast<char*>(arg.c_str()));
+        // Stdin is either the feeder pipe or /dev/null
+        if (feeder.childFd() >= 0) {
+            dup2(feeder.childFd(), STDIN_FILENO);
+        } else {
+            int devnull = open("/dev/null", O_RDONLY);
+            dup2(devnull, STDIN_FILENO);
+            close(devnull);
         }
-        execArgs.push_back(NULL);
+
+        progress.applyInChild();
+        limits.applyInChild();
 
         // Execute the executable
         if (execvp(execArgs[0], execArgs.data()) == -1) {
             std::cerr << "Error: execvp failed\n";
-            exit(1);
+            _exit(127);
         }
     } else {
         // Parent process
         close(stdout_pipe[1]); // Close unused write end
         close(stderr_pipe[1]); // Close unused write end
+        stdout_pipe[1] = stderr_pipe[1] = -1;
+
+        // Unexpected relay errors end the job, not the process (daemon workers)
+        auto fail = [&](const std::string& message) {
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+            closePipes();
+            throw std::runtime_error(message);
+        };
+
+        feeder.startParent();
+        progress.startParent();
+        sampler.start(pid);
 
         // Read from child's stdout and stderr concurrently
         char buffer[4096];
+        size_t outputBytes = 0;
+        bool outputKilled = false;
         bool stdout_eof = false;
         bool stderr_eof = false;
 
         fd_set readfds;
-        int maxfd = std::max(stdout_pipe[0], stderr_pipe[0]) + 1;
+        fd_set writefds;
 
         while (!stdout_eof || !stderr_eof) {
             FD_ZERO(&readfds);
+            FD_ZERO(&writefds);
+            int maxfd = std::max(stdout_pipe[0], stderr_pipe[0]) + 1;
             if (!stdout_eof)
                 FD_SET(stdout_pipe[0], &readfds);
             if (!stderr_eof)
                 FD_SET(stderr_pipe[0], &readfds);
+            feeder.addFds(readfds, writefds, maxfd);
 
-            int ret = select(maxfd, &readfds, NULL, NULL, NULL);
+            // Wake up for the sampler and progress even when the child is quiet
+            struct timeval timeout;
+            struct timeval* timeoutPtr = NULL;
+            int waitMs = earliest(sampler.timeoutMs(), progress.timeoutMs());
+            if (waitMs >= 0) {
+                timeout.tv_sec = waitMs / 1000;
+                timeout.tv_usec = (waitMs % 1000) * 1000;
+                timeoutPtr = &timeout;
+            }
+
+            int ret = select(maxfd, &readfds, &writefds, NULL, timeoutPtr);
             if (ret == -1) {
-                perror("select");
-                exit(1);
+                if (errno == EINTR) continue;
+                fail(std::string("Error: select failed: ") + strerror(errno));
             }
+            sampler.poll();
+            progress.poll();
+            if (ret == 0) continue;
+
+            feeder.pump(readfds, writefds);
 
             if (FD_ISSET(stdout_pipe[0], &readfds)) {
                 ssize_t nbytes = read(stdout_pipe[0], buffer, sizeof(buffer));
-                if (nbytes > 0) {
+                if (nbytes > 0 && !outputKilled) {
+                    outputBytes += nbytes;
+                    if (!limits.allowOutput(outputBytes)) {
+                        // Keep what fits in the budget, then stop the child
+                        nbytes -= outputBytes - args.maxOutput;
+                        kill(pid, SIGKILL);
+                        outputKilled = true;
+                        result.limitHit = "output";
+                        log.LOGE("Limits: output budget exceeded, child killed\n");
+                    }
                     std::string data(buffer, nbytes);
                     // Replace commas with tabs
                     for (char& c : data) {
                         if (c == ',') c = '\t';
                     }
                     outputFile << data;
+                } else if (nbytes > 0) {
+                    // Over budget: drain until the child's pipe closes
                 } else if (nbytes == 0) {
                     stdout_eof = true;
-                } else {
-                    perror("read stdout");
-                    exit(1);
+                } else if (errno != EINTR) {
+                    fail(std::string("Error: Reading child stdout failed: ") + strerror(errno));
                 }
             }
 
@@ -116,13 +243,13 @@ void App::run() {
                 ssize_t nbytes = read(stderr_pipe[0], buffer, sizeof(buffer));
                 if (nbytes > 0) {
                     std::string data(buffer, nbytes);
+                    limits.scanStderr(data);
                     // Time-tagged error messages
-                    log.LOGE(data);
+                    log.relay(data);
                 } else if (nbytes == 0) {
                     stderr_eof = true;
-                } else {
-                    perror("read stderr");
-                    exit(1);
+                } else if (errno != EINTR) {
+                    fail(std::string("Error: Reading child stderr failed: ") + strerror(errno));
                 }
             }
         }
@@ -133,13 +260,24 @@ void App::run() {
         // Wait for child process to finish and collect resource usage
         int status;
         struct rusage usage;
-        if (wait4(pid, &status, 0, &usage) == -1) {
-            std::cerr << "Error: wait4 failed\n";
-            exit(1);
+        while (wait4(pid, &status, 0, &usage) == -1) {
+            if (errno != EINTR) {
+                throw std::runtime_error(std::string("Error: wait4 failed: ") + strerror(errno));
+            }
         }
 
+        struct timespec endTime;
+        clock_gettime(CLOCK_MONOTONIC, &endTime);
+        result.wallTime = (endTime.tv_sec - startTime.tv_sec) + (endTime.tv_nsec - startTime.tv_nsec) / 1e9;
+
         result.userCPUTime = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
         result.systemCPUTime = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
         result.maxRSS = usage.ru_maxrss;
+        result.exitStatus = status;
+        result.stdinBytes = feeder.bytes();
+        limits.collect(status, result);
+        sampler.finish(result);
+        perf.collect(result);
+        progress.finish(result);
     }
 }
\ No newline at end of file
@@ -8,6 +8,8 @@
 #include "args.h"
 #include "log.h"
 #include "result.h"
+#include <vector>
+#include <sys/types.h>
 
 class App {
 public:
@@ -19,6 +21,9 @@ public:
 private:
     const Args& args;
     Log& log;
+
+    pid_t spawn(std::vector<char*>& execArgs, int stdout_pipe[2], int stderr_pipe[2], int stdinFd,
+                int telemetryFd);
 };
 
 #endif // APP_H
\ No newline at end of file
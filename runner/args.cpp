@@ -8,6 +8,7 @@
 #include "args.h"
 #include <iostream>
 #include <sstream>
+#include <limits>
 
 Args::Args(int argc, char* argv[]) : argc(argc), argv(argv) {
     parse();
@@ -15,9 +16,35 @@ Args::Args(int argc, char* argv[]) : argc(argc), argv(argv) {
 
 void Args::printUsage() {
     std::cout << "Usage: sanbox --input <input_file> --output <output_file> --log <log_file> -- <executable> [args...]\n";
+    std::cout << "       sanbox --serve <socket> [--workers <n>]\n";
     std::cout << "  --input  <file>:<type>:<date>   : Input file to be sent to the executable\n";
     std::cout << "  --output <output_file>          : File to store the executable's output\n";
     std::cout << "  --log    <log_file>             : File to store error logs\n";
+    std::cout << "  --mem-limit <size>              : Memory budget, e.g. 512M (cgroup memory.max or RLIMIT_AS)\n";
+    std::cout << "  --cpu-time <seconds>            : CPU time budget (RLIMIT_CPU)\n";
+    std::cout << "  --cpu-share <percent>           : CPU bandwidth, 100 = one full CPU (cgroup cpu.max)\n";
+    std::cout << "  --max-files <n>                 : Open file descriptor budget (RLIMIT_NOFILE)\n";
+    std::cout << "  --max-output <size>             : Output byte budget, child is killed when exceeded\n";
+    std::cout << "  --cgroup-root <dir>             : Delegated cgroup v2 directory to create job groups in\n";
+    std::cout << "  --sample <file>                 : Write a CSV time series of the child's /proc counters\n";
+    std::cout << "  --sample-interval <ms>          : Sampling interval, at least 10 ms (default 100)\n";
+    std::cout << "  --no-perf                       : Do not attach perf_event_open counters to the child\n";
+    std::cout << "  --no-telemetry                  : Do not offer the child a shared-memory telemetry channel\n";
+    std::cout << "  --stats <file>                  : Also write the execution statistics as JSON\n";
+    std::cout << "  --stdin                         : Stream the input file into the child's stdin (--input -)\n";
+    std::cout << "  --stdin-from <path>             : Stream a file, FIFO or - (our stdin) into the child's stdin\n";
+    std::cout << "  --repeat <n>                    : Benchmark: measured iterations (default 1)\n";
+    std::cout << "  --warmup <k>                    : Benchmark: unmeasured iterations run first\n";
+    std::cout << "  --reset <file>                  : Benchmark: restore this file before each iteration (repeatable)\n";
+    std::cout << "  --drop-caches                   : Benchmark: evict input and reset files from the page cache first\n";
+    std::cout << "  --prewarm                       : Benchmark: read the input into the page cache first\n";
+    std::cout << "  --baseline <file>               : Benchmark: compare against a saved baseline\n";
+    std::cout << "  --save-baseline <file>          : Benchmark: save this run as a baseline\n";
+    std::cout << "  --cache <dir>                   : Reuse output, log and statistics of an identical earlier job\n";
+    std::cout << "  --cache-size <size>             : Result cache size bound, LRU eviction (default 1G)\n";
+    std::cout << "  --serve <socket>                : Run as a daemon accepting jobs on a Unix socket\n";
+    std::cout << "  --workers <n>                   : Pre-forked daemon workers (default: one per CPU)\n";
+    std::cout << "  --connect <socket>              : Submit this job to a runner daemon\n";
     std::cout << "  --                              : Separator for executable and its arguments\n";
     std::cout << "  <executable>                    : The executable to run in the sandbox\n";
     std::cout << "  [args...]                       : Optional arguments for the executable\n";
@@ -46,9 +73,57 @@ void Args::parseInputFormat(const std::string& input) {
     executableArgs.push_back(parts[2]);
 }
 
+long Args::parseCount(const std::string& value) {
+    // Plain decimal only: seconds, counts and percentages take no suffix
+    if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos) {
+        throw std::runtime_error("Error: Invalid number '" + value + "'");
+    }
+    try {
+        return std::stol(value);
+    } catch (const std::exception&) {
+        throw std::runtime_error("Error: Invalid number '" + value + "'");
+    }
+}
+
+long Args::parseSize(const std::string& value) {
+    size_t pos = 0;
+    long number;
+    try {
+        number = std::stol(value, &pos);
+    } catch (const std::exception&) {
+        throw std::runtime_error("Error: Invalid size '" + value + "'");
+    }
+    if (number < 0) {
+        throw std::runtime_error("Error: Invalid size '" + value + "'");
+    }
+    std::string suffix = value.substr(pos);
+    int shift;
+    if (suffix.empty()) shift = 0;
+    else if (suffix == "K" || suffix == "k") shift = 10;
+    else if (suffix == "M" || suffix == "m") shift = 20;
+    else if (suffix == "G" || suffix == "g") shift = 30;
+    else throw std::runtime_error("Error: Invalid size suffix '" + suffix + "'");
+    if (number > (std::numeric_limits<long>::max() >> shift)) {
+        throw std::runtime_error("Error: Size '" + value + "' is too large");
+    }
+    return number << shift;
+}
+
 // In runner's args.cpp
 void Args::parse() {
     bool execArgsStart = false;
+    bool streamInput = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        if (!execArgsStart && arg == "--connect") {
+            ++i;
+        } else {
+            forwardArgs.push_back(arg);
+        }
+        if (arg == "--") execArgsStart = true;
+    }
+
+    execArgsStart = false;
     for (int i = 1; i < argc; ++i) {
         std::string arg(argv[i]);
         if (!execArgsStart) {
@@ -70,6 +145,137 @@ void Args::parse() {
                 } else {
                     throw std::runtime_error("Error: Missing log file name after --log");
                 }
+            } else if (arg == "--mem-limit") {
+                if (i + 1 < argc) {
+                    memLimit = parseSize(argv[++i]);
+                } else {
+                    throw std::runtime_error("Error: Missing value after --mem-limit");
+                }
+            } else if (arg == "--cpu-time") {
+                if (i + 1 < argc) {
+                    cpuTimeLimit = parseCount(argv[++i]);
+                } else {
+                    throw std::runtime_error("Error: Missing value after --cpu-time");
+                }
+            } else if (arg == "--cpu-share") {
+                if (i + 1 < argc) {
+                    cpuShare = parseCount(argv[++i]);
+                } else {
+                    throw std::runtime_error("Error: Missing value after --cpu-share");
+                }
+            } else if (arg == "--max-files") {
+                if (i + 1 < argc) {
+                    maxFiles = parseCount(argv[++i]);
+                } else {
+                    throw std::runtime_error("Error: Missing value after --max-files");
+                }
+            } else if (arg == "--max-output") {
+                if (i + 1 < argc) {
+                    maxOutput = parseSize(argv[++i]);
+                } else {
+                    throw std::runtime_error("Error: Missing value after --max-output");
+                }
+            } else if (arg == "--cgroup-root") {
+                if (i + 1 < argc) {
+                    cgroupRoot = argv[++i];
+                } else {
+                    throw std::runtime_error("Error: Missing directory after --cgroup-root");
+                }
+            } else if (arg == "--sample") {
+                if (i + 1 < argc) {
+                    sampleFileName = argv[++i];
+                } else {
+                    throw std::runtime_error("Error: Missing file name after --sample");
+                }
+            } else if (arg == "--sample-interval") {
+                if (i + 1 < argc) {
+                    sampleIntervalMs = parseCount(argv[++i]);
+                } else {
+                    throw std::runtime_error("Error: Missing value after --sample-interval");
+                }
+            } else if (arg == "--no-perf") {
+                perf = false;
+            } else if (arg == "--no-telemetry") {
+                telemetry = false;
+            } else if (arg == "--stats") {
+                if (i + 1 < argc) {
+                    statsFileName = argv[++i];
+                } else {
+                    throw std::runtime_error("Error: Missing file name after --stats");
+                }
+            } else if (arg == "--stdin") {
+                streamInput = true;
+            } else if (arg == "--stdin-from") {
+                if (i + 1 < argc) {
+                    stdinSource = argv[++i];
+                } else {
+                    throw std::runtime_error("Error: Missing path after --stdin-from");
+                }
+            } else if (arg == "--repeat") {
+                if (i + 1 < argc) {
+                    repeat = parseCount(argv[++i]);
+                    if (repeat < 1) throw std::runtime_error("Error: --repeat must be at least 1");
+                } else {
+                    throw std::runtime_error("Error: Missing value after --repeat");
+                }
+            } else if (arg == "--warmup") {
+                if (i + 1 < argc) {
+                    warmup = parseCount(argv[++i]);
+                } else {
+                    throw std::runtime_error("Error: Missing value after --warmup");
+                }
+            } else if (arg == "--reset") {
+                if (i + 1 < argc) {
+                    resetFiles.push_back(argv[++i]);
+                } else {
+                    throw std::runtime_error("Error: Missing file name after --reset");
+                }
+            } else if (arg == "--drop-caches") {
+                dropCaches = true;
+            } else if (arg == "--prewarm") {
+                prewarm = true;
+            } else if (arg == "--baseline") {
+                if (i + 1 < argc) {
+                    baselineFileName = argv[++i];
+                } else {
+                    throw std::runtime_error("Error: Missing file name after --baseline");
+                }
+            } else if (arg == "--save-baseline") {
+                if (i + 1 < argc) {
+                    saveBaselineFileName = argv[++i];
+                } else {
+                    throw std::runtime_error("Error: Missing file name after --save-baseline");
+                }
+            } else if (arg == "--cache") {
+                if (i + 1 < argc) {
+                    cacheDir = argv[++i];
+                } else {
+                    throw std::runtime_error("Error: Missing directory after --cache");
+                }
+            } else if (arg == "--cache-size") {
+                if (i + 1 < argc) {
+                    cacheSize = parseSize(argv[++i]);
+                } else {
+                    throw std::runtime_error("Error: Missing value after --cache-size");
+                }
+            } else if (arg == "--serve") {
+                if (i + 1 < argc) {
+                    serveSocket = argv[++i];
+                } else {
+                    throw std::runtime_error("Error: Missing socket path after --serve");
+                }
+            } else if (arg == "--workers") {
+                if (i + 1 < argc) {
+                    workers = parseCount(argv[++i]);
+                } else {
+                    throw std::runtime_error("Error: Missing value after --workers");
+                }
+            } else if (arg == "--connect") {
+                if (i + 1 < argc) {
+                    connectSocket = argv[++i];
+                } else {
+                    throw std::runtime_error("Error: Missing socket path after --connect");
+                }
             } else if (arg == "--") {
                 execArgsStart = true;
             } else {
@@ -83,6 +289,26 @@ void Args::parse() {
             }
         }
     }
+    if (!serveSocket.empty()) {
+        return;
+    }
+    if (dropCaches && prewarm) {
+        throw std::runtime_error("Error: --drop-caches and --prewarm are mutually exclusive");
+    }
+    if (!cacheDir.empty() && (repeat > 1 || warmup > 0 ||
+                              !baselineFileName.empty() || !saveBaselineFileName.empty())) {
+        throw std::runtime_error("Error: --cache cannot be combined with benchmark options");
+    }
+    if (streamInput || !stdinSource.empty()) {
+        if (stdinSource.empty()) stdinSource = inputFileName;
+        // The child reads its data from stdin instead of the file
+        for (size_t i = 0; i + 1 < executableArgs.size(); ++i) {
+            if (executableArgs[i] == "--input") {
+                executableArgs[i + 1] = "-";
+                break;
+            }
+        }
+    }
     if (inputFileName.empty() || outputFileName.empty() || logFileName.empty() || executableName.empty()) {
         throw std::runtime_error("Error: Missing required arguments");
     }
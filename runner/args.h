@@ -16,8 +16,49 @@ public:
     std::string executableName;
     std::vector<std::string> executableArgs;
 
+    // Resource budgets (0 = unlimited)
+    long memLimit = 0;           // bytes
+    long cpuTimeLimit = 0;       // seconds
+    long cpuShare = 0;           // percent of one CPU
+    long maxFiles = 0;           // open file descriptors
+    long maxOutput = 0;          // bytes written to the output file
+    std::string cgroupRoot;      // delegated cgroup v2 directory
+
+    // Time-series sampling of the child
+    std::string sampleFileName;
+    long sampleIntervalMs = 100;
+
+    // perf_event_open counters and machine-readable statistics
+    bool perf = true;
+    bool telemetry = true;       // shared-memory progress channel
+    std::string statsFileName;
+
+    // Stream a file/FIFO/pipe into the child's stdin ("-" = our own stdin)
+    std::string stdinSource;
+
+    // Benchmark mode
+    long repeat = 1;
+    long warmup = 0;
+    std::vector<std::string> resetFiles;   // restored before every iteration
+    bool dropCaches = false;
+    bool prewarm = false;
+    std::string baselineFileName;          // compare against
+    std::string saveBaselineFileName;      // write this run's summary
+
+    // Result cache (--cache), not used in benchmark mode
+    std::string cacheDir;
+    long cacheSize = 1L << 30;   // bytes
+
+    // Daemon mode
+    std::string serveSocket;     // --serve: listen for jobs on this socket
+    long workers = 0;            // pre-forked workers, 0 = one per CPU
+    std::string connectSocket;   // --connect: submit this job to a daemon
+    std::vector<std::string> forwardArgs;  // our arguments minus --connect
+
     Args(int argc, char* argv[]);
     static void printUsage();
+    static long parseSize(const std::string& value);
+    static long parseCount(const std::string& value);
 
 private:
     int argc;
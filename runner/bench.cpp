@@ -0,0 +1,234 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#include "bench.h"
+#include "app.h"
+#include "stats.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <map>
+#include <cmath>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+// Cache control is best effort: warn, don't fail the benchmark
+void adviseFile(const std::string& path, bool drop) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    if (drop) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    } else {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        char buffer[1 << 16];
+        while (read(fd, buffer, sizeof(buffer)) > 0) {}
+    }
+    close(fd);
+}
+}
+
+Bench::Bench(const Args& args, Log& log) : args(args), log(log) {}
+
+Bench::~Bench() {
+    removeSnapshots();
+}
+
+bool Bench::requested(const Args& args) {
+    return args.repeat > 1 || args.warmup > 0 ||
+           !args.baselineFileName.empty() || !args.saveBaselineFileName.empty();
+}
+
+std::string Bench::snapshotName(const std::string& path) {
+    // Next to the original, so the copy stays on the same filesystem
+    return path + ".runner-snapshot";
+}
+
+void Bench::snapshot() {
+    for (const auto& path : args.resetFiles) {
+        bool exists = fs::exists(path);
+        existed.push_back(exists);
+        if (exists) {
+            fs::copy_file(path, snapshotName(path), fs::copy_options::overwrite_existing);
+        }
+    }
+}
+
+void Bench::restore() {
+    for (size_t i = 0; i < args.resetFiles.size(); ++i) {
+        const auto& path = args.resetFiles[i];
+        if (existed[i]) {
+            fs::copy_file(snapshotName(path), path, fs::copy_options::overwrite_existing);
+        } else {
+            fs::remove(path);
+        }
+    }
+    // Fresh output file for every iteration
+    fs::remove(args.outputFileName);
+}
+
+void Bench::removeSnapshots() {
+    for (size_t i = 0; i < existed.size(); ++i) {
+        if (existed[i]) {
+            std::error_code ec;
+            fs::remove(snapshotName(args.resetFiles[i]), ec);
+        }
+    }
+}
+
+void Bench::prepareCaches() {
+    if (!args.dropCaches && !args.prewarm) return;
+
+    std::vector<std::string> files = args.resetFiles;
+    files.push_back(args.stdinSource.empty() ? args.inputFileName : args.stdinSource);
+
+    if (args.dropCaches && geteuid() == 0) {
+        // Root can drop the whole page cache, which also covers the executable
+        sync();
+        std::ofstream dropCachesFile("/proc/sys/vm/drop_caches");
+        if (dropCachesFile << "1" << std::flush) return;
+    }
+    for (const auto& path : files) {
+        adviseFile(path, args.dropCaches);
+    }
+}
+
+void Bench::measure(std::vector<double>& wall, std::vector<double>& cpu, std::vector<double>& rss, long& failed) {
+    long total = args.warmup + args.repeat;
+    for (long i = 0; i < total; ++i) {
+        bool measured = i >= args.warmup;
+        restore();
+        prepareCaches();
+
+        App app(args, log);
+        app.run();
+        const Result& r = app.result;
+
+        // A failed run measures something else; keep it out of the summary
+        bool ok = WIFEXITED(r.exitStatus) && WEXITSTATUS(r.exitStatus) == 0 && r.limitHit.empty();
+        if (!ok) {
+            log.LOGE("Bench: iteration " + std::to_string(i + 1) +
+                     (r.limitHit.empty() ? " exited abnormally" : " exceeded its " + r.limitHit + " budget") +
+                     (measured ? ", excluded from the summary\n" : "\n"));
+        }
+        std::cout << (measured ? "Iteration " : "Warmup ") << (measured ? i - args.warmup + 1 : i + 1)
+                  << ": wall " << r.wallTime << " sec, cpu " << r.userCPUTime + r.systemCPUTime
+                  << " sec, max RSS " << r.maxRSS << " KB"
+                  << (r.limitHit.empty() ? "" : ", limit exceeded: " + r.limitHit)
+                  << (ok || !measured ? "" : ", excluded") << "\n";
+        if (!measured) continue;
+        if (!ok) {
+            ++failed;
+            continue;
+        }
+        wall.push_back(r.wallTime);
+        cpu.push_back(r.userCPUTime + r.systemCPUTime);
+        rss.push_back(r.maxRSS);
+    }
+}
+
+Bench::Summary Bench::summarize(const std::vector<double>& values) {
+    Summary s;
+    if (values.empty()) return s;
+    s.min = *std::min_element(values.begin(), values.end());
+    s.median = percentile(values, 0.50);
+    s.p95 = percentile(values, 0.95);
+    for (double v : values) s.mean += v;
+    s.mean /= values.size();
+    for (double v : values) s.stddev += (v - s.mean) * (v - s.mean);
+    s.stddev = values.size() > 1 ? std::sqrt(s.stddev / (values.size() - 1)) : 0;
+    return s;
+}
+
+void Bench::run() {
+    snapshot();
+
+    std::vector<double> wall, cpu, rss;
+    long failed = 0;
+    try {
+        measure(wall, cpu, rss, failed);
+    } catch (...) {
+        // Leave the --reset files as we found them, whatever the iteration did
+        try {
+            restore();
+        } catch (const std::exception& e) {
+            log.LOGE(std::string("Bench: cannot restore reset files: ") + e.what() + "\n");
+        }
+        throw;
+    }
+    restore();
+
+    if (failed == args.repeat) {
+        throw std::runtime_error("Error: Every measured iteration failed, no benchmark summary");
+    }
+
+    std::vector<std::pair<std::string, Summary>> summaries = {
+        {"wall", summarize(wall)},
+        {"cpu", summarize(cpu)},
+        {"maxrss", summarize(rss)},
+    };
+
+    std::cout << "\nBenchmark: " << args.repeat << " iterations, " << args.warmup << " warmup";
+    if (failed > 0) {
+        std::cout << ", " << failed << " failed and excluded";
+    }
+    std::cout << "\n";
+    std::cout << std::left << std::setw(8) << "metric" << std::right
+              << std::setw(12) << "min" << std::setw(12) << "median" << std::setw(12) << "p95"
+              << std::setw(12) << "mean" << std::setw(12) << "stddev" << "\n";
+    for (const auto& [name, s] : summaries) {
+        std::cout << std::left << std::setw(8) << name << std::right
+                  << std::setw(12) << s.min << std::setw(12) << s.median << std::setw(12) << s.p95
+                  << std::setw(12) << s.mean << std::setw(12) << s.stddev << "\n";
+    }
+
+    if (!args.baselineFileName.empty()) {
+        std::ifstream in(args.baselineFileName);
+        if (!in.is_open()) {
+            throw std::runtime_error("Error: Cannot open baseline " + args.baselineFileName);
+        }
+        std::map<std::string, Summary> baseline;
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            std::istringstream fields(line);
+            std::string name;
+            Summary s;
+            if (fields >> name >> s.min >> s.median >> s.p95 >> s.mean >> s.stddev) {
+                baseline[name] = s;
+            }
+        }
+
+        std::cout << "\nAgainst baseline " << args.baselineFileName << ":\n";
+        for (const auto& [name, s] : summaries) {
+            auto it = baseline.find(name);
+            if (it == baseline.end()) continue;
+            const Summary& b = it->second;
+            double delta = s.median - b.median;
+            double percent = b.median != 0 ? delta * 100 / b.median : 0;
+            // Call it noise unless the medians differ by more than two stddevs
+            bool significant = std::fabs(delta) > 2 * std::max(s.stddev, b.stddev);
+            std::cout << "  " << std::left << std::setw(8) << name << std::right
+                      << "median " << s.median << " vs " << b.median << " ("
+                      << std::showpos << percent << std::noshowpos << "%), "
+                      << (significant ? "significant" : "within noise") << "\n";
+        }
+    }
+
+    if (!args.saveBaselineFileName.empty()) {
+        std::ofstream out(args.saveBaselineFileName);
+        out << "# runner baseline: " << args.executableName << ", " << args.repeat << " iterations\n";
+        out << "# metric min median p95 mean stddev\n";
+        for (const auto& [name, s] : summaries) {
+            out << name << " " << s.min << " " << s.median << " " << s.p95 << " "
+                << s.mean << " " << s.stddev << "\n";
+        }
+    }
+}
@@ -0,0 +1,50 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "args.h"
+#include "log.h"
+#include <string>
+#include <vector>
+
+// runner --repeat N --warmup K: run the same job repeatedly against freshly
+// restored --reset files and report wall time, CPU time and max RSS
+// statistics, optionally against a saved baseline. Iterations that fail or
+// exceed a budget are excluded; the reset files are restored even when an
+// iteration throws.
+class Bench {
+public:
+    Bench(const Args& args, Log& log);
+    ~Bench();
+
+    static bool requested(const Args& args);
+    void run();
+
+private:
+    struct Summary {
+        double min = 0;
+        double median = 0;
+        double p95 = 0;
+        double mean = 0;
+        double stddev = 0;
+    };
+
+    const Args& args;
+    Log& log;
+    std::vector<bool> existed;     // per reset file, before the first iteration
+
+    void snapshot();
+    void restore();
+    void removeSnapshots();
+    void prepareCaches();
+    // The iterations; abnormal exits and budget hits are counted in failed
+    // and left out of the vectors.
+    void measure(std::vector<double>& wall, std::vector<double>& cpu, std::vector<double>& rss, long& failed);
+    static Summary summarize(const std::vector<double>& values);
+    static std::string snapshotName(const std::string& path);
+};
+
+#endif // BENCH_H
@@ -0,0 +1,295 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#include "cache.h"
+#include "sha256.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <linux/fs.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+// Bumped whenever the key or entry layout changes
+constexpr const char* kKeyVersion = "runner-cache-2";
+constexpr const char* kResultName = "result.json";
+
+// The file execvp() would run
+std::string resolveExecutable(const std::string& name) {
+    if (name.find('/') != std::string::npos) return name;
+    const char* path = getenv("PATH");
+    std::string dirs = path ? path : "/usr/local/bin:/usr/bin:/bin";
+    size_t start = 0;
+    while (start <= dirs.size()) {
+        size_t end = dirs.find(':', start);
+        if (end == std::string::npos) end = dirs.size();
+        std::string dir = end > start ? dirs.substr(start, end - start) : ".";
+        std::string candidate = dir + "/" + name;
+        struct stat st;
+        if (stat(candidate.c_str(), &st) == 0 && S_ISREG(st.st_mode) && access(candidate.c_str(), X_OK) == 0) {
+            return candidate;
+        }
+        start = end + 1;
+    }
+    return "";
+}
+
+bool regularFile(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// Reflink when the filesystem shares extents (btrfs, XFS), else a real copy
+bool cloneOrCopy(const std::string& from, const std::string& to) {
+    int in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        close(in);
+        return false;
+    }
+    bool cloned = ioctl(out, FICLONE, in) == 0;
+    close(in);
+    close(out);
+    if (cloned) return true;
+    std::error_code ec;
+    return fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec);
+}
+
+// Entry files to job paths. Never a hard link: the job path must be a file
+// of its own, writable by the next run with or without --cache.
+bool place(const std::string& from, const std::string& to) {
+    if (unlink(to.c_str()) != 0 && errno != ENOENT) return false;
+    // copy_file() carries over the entry's 0444
+    return cloneOrCopy(from, to) && chmod(to.c_str(), 0644) == 0;
+}
+
+bool earlier(const struct timespec& a, const struct timespec& b) {
+    return a.tv_sec != b.tv_sec ? a.tv_sec < b.tv_sec : a.tv_nsec < b.tv_nsec;
+}
+}
+
+ResultCache::ResultCache(const Args& args) : args(args) {
+    if (args.cacheDir.empty()) return;
+
+    std::error_code ec;
+    fs::create_directories(fs::path(args.cacheDir) / "entries", ec);
+    fs::create_directories(fs::path(args.cacheDir) / "stamps", ec);
+    if (ec) {
+        std::cerr << "Cache: cannot create " << args.cacheDir << ", running uncached\n";
+        return;
+    }
+    // A FIFO or our own stdin cannot be hashed without consuming it
+    if (!args.stdinSource.empty() && args.stdinSource != args.inputFileName &&
+        !regularFile(args.stdinSource)) {
+        std::cerr << "Cache: stdin source is not a regular file, running uncached\n";
+        return;
+    }
+
+    std::string executable = resolveExecutable(args.executableName);
+    std::string executableDigest = executable.empty() ? "" : digest(executable);
+    std::string inputDigest = digest(args.inputFileName);
+    if (executableDigest.empty() || inputDigest.empty()) {
+        std::cerr << "Cache: cannot read the executable or input, running uncached\n";
+        return;
+    }
+
+    // NUL-separated, so argument boundaries are part of the key
+    Sha256 sha;
+    sha.update(kKeyVersion, strlen(kKeyVersion) + 1);
+    sha.update(executableDigest.c_str(), executableDigest.size() + 1);
+    for (const auto& arg : args.executableArgs) {
+        sha.update(arg.c_str(), arg.size() + 1);
+    }
+    sha.update(inputDigest.c_str(), inputDigest.size() + 1);
+    if (!args.stdinSource.empty() && args.stdinSource != args.inputFileName) {
+        std::string stdinDigest = digest(args.stdinSource);
+        sha.update(stdinDigest.c_str(), stdinDigest.size() + 1);
+    }
+    // Budgets change what the job may produce and measurement options change
+    // the Result, so both are part of the key, in parsed (normalized) form
+    std::string options = "mem=" + std::to_string(args.memLimit) +
+                          " cpu=" + std::to_string(args.cpuTimeLimit) +
+                          " share=" + std::to_string(args.cpuShare) +
+                          " files=" + std::to_string(args.maxFiles) +
+                          " output=" + std::to_string(args.maxOutput) +
+                          " cgroup=" + args.cgroupRoot +
+                          " sample=" + (args.sampleFileName.empty() ? "0" : std::to_string(args.sampleIntervalMs)) +
+                          " perf=" + (args.perf ? "1" : "0") +
+                          " telemetry=" + (args.telemetry ? "1" : "0") +
+                          " stats=" + (args.statsFileName.empty() ? "0" : "1");
+    sha.update(options.c_str(), options.size() + 1);
+    key = sha.hexDigest();
+}
+
+std::string ResultCache::digest(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return "";
+
+    // ctime moves on every write and cannot be set back by the writer
+    std::string stamp = std::to_string(st.st_dev) + ":" + std::to_string(st.st_ino) + ":" +
+                        std::to_string(st.st_size) + ":" +
+                        std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec) + ":" +
+                        std::to_string(st.st_ctim.tv_sec) + "." + std::to_string(st.st_ctim.tv_nsec);
+    fs::path stampFile = fs::path(args.cacheDir) / "stamps" / Sha256::hex(stamp);
+
+    stampsUsed.push_back(stampFile.string());
+
+    std::string known;
+    std::ifstream(stampFile) >> known;
+    if (known.size() == 64) return known;
+
+    std::string computed = Sha256::file(path);
+    if (!computed.empty()) {
+        // Write then rename, so a concurrent reader never sees half a digest
+        std::string tmp = stampFile.string() + ".tmp" + std::to_string(getpid());
+        if (std::ofstream(tmp) << computed << "\n") {
+            rename(tmp.c_str(), stampFile.c_str());
+        } else {
+            unlink(tmp.c_str());
+        }
+    }
+    return computed;
+}
+
+std::string ResultCache::entryDir() const {
+    return (fs::path(args.cacheDir) / "entries" / key).string();
+}
+
+std::vector<std::pair<std::string, std::string>> ResultCache::artifacts() const {
+    std::vector<std::pair<std::string, std::string>> files = {
+        {"output", args.outputFileName},
+        {"log", args.logFileName},
+    };
+    if (!args.sampleFileName.empty()) {
+        files.emplace_back("sample", args.sampleFileName);
+    }
+    return files;
+}
+
+bool ResultCache::restore(Result& result) {
+    if (!enabled()) return false;
+
+    std::string entry = entryDir();
+    std::ifstream json(entry + "/" + kResultName);
+    Result cached;
+    if (!json.is_open() || !cached.readJson(json)) return false;
+    for (const auto& [name, path] : artifacts()) {
+        if (!regularFile(entry + "/" + name)) return false;
+    }
+    for (const auto& [name, path] : artifacts()) {
+        if (!place(entry + "/" + name, path)) {
+            std::cerr << "Cache: cannot restore " << path << ", running the job\n";
+            return false;
+        }
+    }
+
+    // The entry directory's mtime is its LRU timestamp
+    utimensat(AT_FDCWD, entry.c_str(), NULL, 0);
+    touchStamps();
+    result = cached;
+    result.cached = true;
+    return true;
+}
+
+void ResultCache::store(const Result& result) {
+    if (!enabled()) return;
+    // Only clean successes are worth replaying
+    if (!WIFEXITED(result.exitStatus) || WEXITSTATUS(result.exitStatus) != 0 || !result.limitHit.empty()) {
+        return;
+    }
+
+    std::string entry = entryDir();
+    std::string tmp = (fs::path(args.cacheDir) / "entries" / (".tmp-" + std::to_string(getpid()) + "-" + key)).string();
+    std::error_code ec;
+    fs::remove_all(tmp, ec);
+    fs::create_directory(tmp, ec);
+    bool complete = !ec;
+
+    for (const auto& [name, path] : artifacts()) {
+        if (!complete) break;
+        std::string file = tmp + "/" + name;
+        // Never hard link here: the job's files are rewritten by the next run
+        complete = cloneOrCopy(path, file);
+        chmod(file.c_str(), 0444);
+    }
+    if (complete) {
+        std::ofstream json(tmp + "/" + kResultName);
+        result.writeJson(json);
+        complete = static_cast<bool>(json);
+        chmod((tmp + "/" + kResultName).c_str(), 0444);
+    }
+
+    // rename() publishes the entry atomically; losing a race to another
+    // runner storing the same key is fine
+    if (!complete || rename(tmp.c_str(), entry.c_str()) != 0) {
+        if (!complete) std::cerr << "Cache: cannot store entry in " << args.cacheDir << "\n";
+        fs::remove_all(tmp, ec);
+        return;
+    }
+    touchStamps();
+    evict();
+}
+
+void ResultCache::touchStamps() const {
+    // Never older than the entries whose keys they fed, see evict()
+    for (const auto& stamp : stampsUsed) {
+        utimensat(AT_FDCWD, stamp.c_str(), NULL, 0);
+    }
+}
+
+void ResultCache::evict() {
+    struct Entry {
+        fs::path path;
+        struct timespec used;
+        uintmax_t bytes;
+    };
+    std::vector<Entry> entries;
+    uintmax_t total = 0;
+
+    std::error_code ec;
+    for (const auto& dir : fs::directory_iterator(fs::path(args.cacheDir) / "entries", ec)) {
+        std::string name = dir.path().filename().string();
+        struct stat st;
+        if (name.starts_with(".tmp-") || stat(dir.path().c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            continue;
+        }
+        Entry e = {dir.path(), st.st_mtim, 0};
+        for (const auto& file : fs::directory_iterator(dir.path(), ec)) {
+            e.bytes += file.file_size(ec);
+        }
+        total += e.bytes;
+        entries.push_back(e);
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return earlier(a.used, b.used);
+    });
+    size_t evicted = 0;
+    while (evicted < entries.size() && total > static_cast<uintmax_t>(args.cacheSize)) {
+        fs::remove_all(entries[evicted].path, ec);
+        total -= entries[evicted].bytes;
+        ++evicted;
+    }
+
+    // Stamps are touched whenever an entry built from them is stored or
+    // restored, so one older than the least recently used surviving entry
+    // serves no entry; age it out along with the evicted ones
+    bool keepNone = evicted == entries.size();
+    struct timespec oldest = keepNone ? timespec{} : entries[evicted].used;
+    for (const auto& file : fs::directory_iterator(fs::path(args.cacheDir) / "stamps", ec)) {
+        struct stat st;
+        if (keepNone || (stat(file.path().c_str(), &st) == 0 && earlier(st.st_mtim, oldest))) {
+            unlink(file.path().c_str());
+        }
+    }
+}
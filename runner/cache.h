@@ -0,0 +1,44 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "args.h"
+#include "result.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+// runner --cache <dir>: content-addressed store of finished jobs. The key is
+// a SHA-256 over the executable binary, its arguments and the input file's
+// contents. File digests are remembered per (inode, size, mtime, ctime) so an
+// unchanged file is not re-read. The parsed budgets and measurement options
+// are hashed in as well. An entry holds the output file, the log, the sample
+// CSV if any and the Result. A hit restores them with a reflink, else a copy,
+// and the job is not run. Entries beyond --cache-size are evicted least
+// recently used first, and digest stamps older than every kept entry with them.
+class ResultCache {
+public:
+    explicit ResultCache(const Args& args);
+
+    bool enabled() const { return !key.empty(); }
+    // Before the Log is opened: put a cached entry in place. False on a miss.
+    bool restore(Result& result);
+    // After the Log is flushed: keep a successful run.
+    void store(const Result& result);
+
+private:
+    const Args& args;
+    std::string key;             // hex digest, empty when the job is not cacheable
+    std::vector<std::string> stampsUsed;   // digest stamps that fed the key
+
+    std::string digest(const std::string& path);
+    std::string entryDir() const;
+    std::vector<std::pair<std::string, std::string>> artifacts() const;  // entry name, job path
+    void touchStamps() const;
+    void evict();
+};
+
+#endif // CACHE_H
@@ -0,0 +1,59 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#include "client.h"
+#include "protocol.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+Client::Client(const Args& args) : args(args) {}
+
+void Client::run() {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (args.connectSocket.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Error: Socket path too long");
+    }
+    strcpy(addr.sun_path, args.connectSocket.c_str());
+    if (fd < 0 || connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+        if (fd >= 0) close(fd);
+        throw std::runtime_error("Error: Cannot connect to " + args.connectSocket);
+    }
+
+    // Paths in the job are relative to our working directory, not the daemon's
+    char cwd[4096];
+    std::vector<std::string> request = {getcwd(cwd, sizeof(cwd)) ? cwd : "."};
+    request.insert(request.end(), args.forwardArgs.begin(), args.forwardArgs.end());
+    if (!Protocol::writeFrame(fd, Protocol::kRequest, Protocol::encode(request))) {
+        close(fd);
+        throw std::runtime_error("Error: Failed to send job to " + args.connectSocket);
+    }
+
+    char type;
+    std::string payload;
+    bool done = false;
+    while (Protocol::readFrame(fd, type, payload)) {
+        if (type == Protocol::kOutput) {
+            std::cout << payload;
+            done = true;
+        } else if (type == Protocol::kStats) {
+            if (!args.statsFileName.empty()) {
+                std::ofstream(args.statsFileName) << payload;
+            }
+        } else if (type == Protocol::kError) {
+            close(fd);
+            throw std::runtime_error(payload);
+        }
+    }
+    close(fd);
+    if (!done) {
+        throw std::runtime_error("Error: Runner daemon closed the connection");
+    }
+}
@@ -0,0 +1,21 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include "args.h"
+
+// runner --connect: send this invocation to a runner daemon and print the
+// statistics it streams back, exactly as a local run would.
+class Client {
+public:
+    Client(const Args& args);
+    void run();
+
+private:
+    const Args& args;
+};
+
+#endif // CLIENT_H
@@ -0,0 +1,154 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#include "feeder.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace {
+constexpr size_t kChunk = 1 << 20;
+// Bytes moved per event loop turn, so stdout/stderr are serviced in between
+constexpr size_t kMaxPerPump = 4 << 20;
+
+bool readable(int fd) {
+    struct pollfd p = {fd, POLLIN, 0};
+    return poll(&p, 1, 0) > 0;
+}
+
+bool writable(int fd) {
+    struct pollfd p = {fd, POLLOUT, 0};
+    return poll(&p, 1, 0) > 0 && (p.revents & POLLOUT);
+}
+}
+
+StdinFeeder::StdinFeeder(const Args& args, Log& log) : args(args), log(log) {}
+
+StdinFeeder::~StdinFeeder() {
+    finish();
+    if (pipeFd[0] >= 0) close(pipeFd[0]);
+}
+
+void StdinFeeder::prepare() {
+    if (!enabled()) return;
+
+    if (args.stdinSource == "-") {
+        // Our own copy must not leak into the child beyond its stdin
+        sourceFd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+    } else {
+        // A FIFO blocks here until its producer opens the other end
+        sourceFd = open(args.stdinSource.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (sourceFd < 0) {
+        throw std::runtime_error("Error: Cannot open stdin source " + args.stdinSource);
+    }
+    struct stat st;
+    regularFile = fstat(sourceFd, &st) == 0 && S_ISREG(st.st_mode);
+    waitSource = !regularFile;
+
+    if (pipe2(pipeFd, O_CLOEXEC) != 0) {
+        throw std::runtime_error("Error: Pipe creation failed");
+    }
+    // Larger pipe, fewer wakeups; capped by /proc/sys/fs/pipe-max-size
+    fcntl(pipeFd[1], F_SETPIPE_SZ, kChunk);
+}
+
+void StdinFeeder::startParent() {
+    if (!enabled()) return;
+    close(pipeFd[0]);
+    pipeFd[0] = -1;
+    fcntl(pipeFd[1], F_SETFL, fcntl(pipeFd[1], F_GETFL) | O_NONBLOCK);
+    // A child that stops reading early shows up as EPIPE, not a signal. The
+    // disposition is process-wide, so it is restored once the pipe is closed
+    // rather than left behind for a daemon worker's later jobs.
+    struct sigaction ignore = {};
+    ignore.sa_handler = SIG_IGN;
+    sigemptyset(&ignore.sa_mask);
+    ignorePipe = sigaction(SIGPIPE, &ignore, &savedPipe) == 0;
+}
+
+void StdinFeeder::addFds(fd_set& readfds, fd_set& writefds, int& maxfd) const {
+    if (pipeFd[1] < 0) return;
+    int fd = waitSource ? sourceFd : pipeFd[1];
+    FD_SET(fd, waitSource ? &readfds : &writefds);
+    maxfd = std::max(maxfd, fd + 1);
+}
+
+ssize_t StdinFeeder::transfer() {
+    if (useSplice) {
+        return splice(sourceFd, NULL, pipeFd[1], NULL, kChunk, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    }
+    if (pending.empty()) {
+        if (!regularFile && !readable(sourceFd)) {
+            errno = EAGAIN;
+            return -1;
+        }
+        char buffer[65536];
+        ssize_t n = read(sourceFd, buffer, sizeof(buffer));
+        if (n <= 0) return n;
+        pending.assign(buffer, n);
+    }
+    ssize_t n = write(pipeFd[1], pending.data(), pending.size());
+    if (n > 0) pending.erase(0, n);
+    return n;
+}
+
+void StdinFeeder::pump(const fd_set& readfds, const fd_set& writefds) {
+    if (pipeFd[1] < 0) return;
+    if (!FD_ISSET(waitSource ? sourceFd : pipeFd[1], waitSource ? &readfds : &writefds)) return;
+
+    size_t moved = 0;
+    while (moved < kMaxPerPump) {
+        ssize_t n = transfer();
+        if (n > 0) {
+            moved += n;
+            total += n;
+            continue;
+        }
+        if (n == 0) {
+            finish();
+            return;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN) {
+            // Either side may be the one that is not ready
+            waitSource = !regularFile && pending.empty() && writable(pipeFd[1]);
+            return;
+        }
+        if (errno == EINVAL && useSplice) {
+            // Source type splice() does not support (tty, some sockets)
+            useSplice = false;
+            continue;
+        }
+        if (errno == EPIPE) {
+            log.LOGE("Stdin: child closed stdin after " + std::to_string(total) + " bytes\n");
+        } else {
+            log.LOGE(std::string("Stdin: transfer failed: ") + strerror(errno) + "\n");
+        }
+        finish();
+        return;
+    }
+}
+
+void StdinFeeder::finish() {
+    // Closing the write end delivers EOF to the child
+    if (pipeFd[1] >= 0) {
+        close(pipeFd[1]);
+        pipeFd[1] = -1;
+    }
+    if (sourceFd >= 0) {
+        close(sourceFd);
+        sourceFd = -1;
+    }
+    if (ignorePipe) {
+        sigaction(SIGPIPE, &savedPipe, NULL);
+        ignorePipe = false;
+    }
+}
@@ -0,0 +1,52 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#ifndef FEEDER_H
+#define FEEDER_H
+
+#include "args.h"
+#include "log.h"
+#include <string>
+#include <csignal>
+#include <sys/select.h>
+
+// Streams a file, FIFO or pipe into the child's stdin from the App event
+// loop. Data moves with splice() so it never passes through user space;
+// sources splice() cannot handle fall back to read()/write(). The write end
+// is non-blocking, so a slow child applies backpressure without stalling the
+// stdout/stderr relay.
+class StdinFeeder {
+public:
+    StdinFeeder(const Args& args, Log& log);
+    ~StdinFeeder();
+
+    bool enabled() const { return !args.stdinSource.empty(); }
+    // Parent, before fork: open the source and create the pipe.
+    void prepare();
+    // The pipe end the child should dup2() onto stdin, -1 when disabled.
+    int childFd() const { return pipeFd[0]; }
+    // Parent, after fork: SIGPIPE is ignored while the pipe is open.
+    void startParent();
+    void addFds(fd_set& readfds, fd_set& writefds, int& maxfd) const;
+    void pump(const fd_set& readfds, const fd_set& writefds);
+    size_t bytes() const { return total; }
+
+private:
+    const Args& args;
+    Log& log;
+    int sourceFd = -1;
+    int pipeFd[2] = {-1, -1};
+    bool regularFile = false;
+    bool waitSource = false;    // blocked on the source rather than the pipe
+    bool useSplice = true;
+    std::string pending;        // read()/write() fallback leftovers
+    size_t total = 0;
+    struct sigaction savedPipe = {};
+    bool ignorePipe = false;    // SIGPIPE ignored until finish()
+
+    ssize_t transfer();
+    void finish();
+};
+
+#endif // FEEDER_H
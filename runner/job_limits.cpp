@@ -0,0 +1,187 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#include "job_limits.h"
+#include <fstream>
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace {
+constexpr long kCpuPeriodUs = 100000;
+constexpr size_t kMarkerTail = 32;
+
+// What failed allocations and descriptor exhaustion look like on stderr
+constexpr const char* kNoMemoryMarkers[] = {"Cannot allocate memory", "bad_alloc", "out of memory", "MemoryError"};
+constexpr const char* kNoFilesMarkers[] = {"Too many open files"};
+
+bool isAbnormal(int status) {
+    return WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status) != 0);
+}
+}
+
+Limits::Limits(const Args& args, Log& log) : args(args), log(log) {}
+
+Limits::~Limits() {
+    removeCgroup();
+}
+
+
+bool Limits::writeControl(const std::string& file, const std::string& value) const {
+    int fd = open((cgroupDir + "/" + file).c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = write(fd, value.data(), value.size()) == static_cast<ssize_t>(value.size());
+    close(fd);
+    return ok;
+}
+
+long Limits::readKey(const std::string& file, const std::string& key) const {
+    std::ifstream in(cgroupDir + "/" + file);
+    std::string name;
+    long value;
+    if (key.empty()) {
+        // Single-value file such as memory.peak
+        return (in >> value) ? value : -1;
+    }
+    while (in >> name >> value) {
+        if (name == key) return value;
+    }
+    return -1;
+}
+
+void Limits::prepare() {
+    bool wantCgroup = args.memLimit > 0 || args.cpuShare > 0;
+    if (!wantCgroup) return;
+
+    // No automatic choice: the runner's own group holds the runner, so even a
+    // namespace root refuses subtree_control (EBUSY) under the
+    // no-internal-processes rule. Only the real root cgroup is exempt.
+    std::string base = args.cgroupRoot;
+    if (base.empty()) {
+        log.LOGE("Limits: no --cgroup-root given, using setrlimit\n");
+    } else {
+        // Best effort: an empty delegated parent may need the controllers switched on
+        std::ofstream(base + "/cgroup.subtree_control") << "+memory +cpu";
+
+        std::string dir = base + "/runner-" + std::to_string(getpid());
+        if (mkdir(dir.c_str(), 0755) == 0) {
+            cgroupDir = dir;
+            bool ok = true;
+            if (args.memLimit > 0) {
+                ok = ok && writeControl("memory.max", std::to_string(args.memLimit));
+                // Keep a runaway job from pushing its neighbours into swap
+                writeControl("memory.swap.max", "0");
+            }
+            if (args.cpuShare > 0) {
+                long quota = args.cpuShare * kCpuPeriodUs / 100;
+                ok = ok && writeControl("cpu.max", std::to_string(quota) + " " + std::to_string(kCpuPeriodUs));
+            }
+            if (ok) {
+                procsFd = open((cgroupDir + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+                ok = procsFd >= 0;
+            }
+            if (ok) return;
+            removeCgroup();
+        }
+        log.LOGE("Limits: cgroup v2 not writable under " + base + ", falling back to setrlimit\n");
+    }
+
+    if (args.cpuShare > 0) {
+        log.LOGE("Limits: --cpu-share cannot be enforced without cgroup v2\n");
+    }
+}
+
+void Limits::applyInChild() const {
+    if (procsFd >= 0) {
+        // "0" moves the writing task
+        if (write(procsFd, "0", 1) != 1) {
+            _exit(126);
+        }
+    } else if (args.memLimit > 0) {
+        struct rlimit rl = {static_cast<rlim_t>(args.memLimit), static_cast<rlim_t>(args.memLimit)};
+        setrlimit(RLIMIT_AS, &rl);
+    }
+
+    if (args.cpuTimeLimit > 0) {
+        // SIGXCPU at the soft limit, SIGKILL one second later
+        struct rlimit rl = {static_cast<rlim_t>(args.cpuTimeLimit), static_cast<rlim_t>(args.cpuTimeLimit + 1)};
+        setrlimit(RLIMIT_CPU, &rl);
+    }
+    if (args.maxFiles > 0) {
+        struct rlimit rl = {static_cast<rlim_t>(args.maxFiles), static_cast<rlim_t>(args.maxFiles)};
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+bool Limits::allowOutput(size_t totalBytes) const {
+    return args.maxOutput <= 0 || totalBytes <= static_cast<size_t>(args.maxOutput);
+}
+
+void Limits::scanStderr(const std::string& data) {
+    bool watchMemory = args.memLimit > 0 && !usingCgroup();
+    if ((!watchMemory && args.maxFiles <= 0) || (sawNoMemory && sawNoFiles)) return;
+
+    std::string text = stderrTail + data;
+    if (watchMemory) {
+        for (const char* marker : kNoMemoryMarkers) {
+            sawNoMemory = sawNoMemory || text.find(marker) != std::string::npos;
+        }
+    }
+    if (args.maxFiles > 0) {
+        for (const char* marker : kNoFilesMarkers) {
+            sawNoFiles = sawNoFiles || text.find(marker) != std::string::npos;
+        }
+    }
+    stderrTail = text.size() > kMarkerTail ? text.substr(text.size() - kMarkerTail) : text;
+}
+
+void Limits::collect(int status, Result& result) {
+    result.peakMemory = result.maxRSS * 1024;
+
+    if (WIFSIGNALED(status) && args.cpuTimeLimit > 0 && result.limitHit.empty()) {
+        int sig = WTERMSIG(status);
+        double cpu = result.userCPUTime + result.systemCPUTime;
+        if (sig == SIGXCPU || (sig == SIGKILL && cpu >= args.cpuTimeLimit)) {
+            result.limitHit = "cpu-time";
+        }
+    }
+
+    // Without a cgroup, rlimit hits surface as failed calls in the child;
+    // attribute them when the child failed after reporting one
+    if (result.limitHit.empty() && isAbnormal(status)) {
+        if (sawNoMemory) {
+            result.limitHit = "memory";
+        } else if (sawNoFiles) {
+            result.limitHit = "files";
+        }
+    }
+
+    if (!usingCgroup()) return;
+
+    if (result.limitHit.empty() && readKey("memory.events", "oom_kill") > 0) {
+        result.limitHit = "memory";
+    }
+    long peak = readKey("memory.peak", "");
+    if (peak >= 0) {
+        result.peakMemory = peak;
+    }
+    long throttled = readKey("cpu.stat", "throttled_usec");
+    if (throttled >= 0) {
+        result.throttledTime = throttled / 1e6;
+    }
+}
+
+void Limits::removeCgroup() {
+    if (procsFd >= 0) {
+        close(procsFd);
+        procsFd = -1;
+    }
+    if (!cgroupDir.empty()) {
+        rmdir(cgroupDir.c_str());
+        cgroupDir.clear();
+    }
+}
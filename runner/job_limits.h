@@ -0,0 +1,58 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#ifndef JOB_LIMITS_H
+#define JOB_LIMITS_H
+
+#include "args.h"
+#include "log.h"
+#include "result.h"
+#include <string>
+#include <sys/types.h>
+
+// Per-job resource budgets. Memory and CPU share are enforced through a
+// cgroup v2 job group when one can be created, otherwise through rlimits
+// set in the child between fork and exec. Job groups are only created under
+// --cgroup-root, an empty delegated group: the runner's own group holds the
+// runner itself and, by the no-internal-processes rule, cannot hand
+// controllers to children (a cgroup namespace root is no exception).
+class Limits {
+public:
+    Limits(const Args& args, Log& log);
+    ~Limits();
+
+    // Parent, before fork: create and configure the job cgroup.
+    void prepare();
+    // Child, before exec: join the cgroup and apply rlimits.
+    // Only async-signal-safe calls are made here.
+    void applyInChild() const;
+    // Parent, while relaying: returns false once the output budget is spent.
+    bool allowOutput(size_t totalBytes) const;
+    // Parent, while relaying: watch the child's stderr for allocation and
+    // descriptor failures, the only trace an rlimit hit leaves.
+    void scanStderr(const std::string& data);
+    // Parent, after wait4: attribute the exit and read cgroup accounting.
+    void collect(int status, Result& result);
+
+    bool usingCgroup() const { return !cgroupDir.empty(); }
+    // Whether applyInChild() has anything to do, i.e. plain spawn won't do.
+    bool needsChildHook() const {
+        return procsFd >= 0 || args.memLimit > 0 || args.cpuTimeLimit > 0 || args.maxFiles > 0;
+    }
+
+private:
+    const Args& args;
+    Log& log;
+    std::string cgroupDir;
+    int procsFd = -1;
+    std::string stderrTail;      // carried over so markers can span reads
+    bool sawNoMemory = false;
+    bool sawNoFiles = false;
+
+    bool writeControl(const std::string& file, const std::string& value) const;
+    long readKey(const std::string& file, const std::string& key) const;
+    void removeCgroup();
+};
+
+#endif // JOB_LIMITS_H
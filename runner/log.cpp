@@ -3,32 +3,144 @@
 //
 
 #include "log.h"
-#include <iostream>
-#include <ctime>
-#include <sys/time.h>
-
-Log::Log(const std::string& logFileName) {
-    logFile.open(logFileName, std::ios::out);
-    if (!logFile.is_open()) {
-        std::cerr << "Error: Cannot open log file\n";
-        exit(1);
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+Log::Log(const std::string& logFileName) : ring(kRingSize) {
+    logFd = open(logFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (logFd < 0) {
+        throw std::runtime_error("Error: Cannot open log file " + logFileName);
     }
+    flusher = std::thread(&Log::run, this);
 }
 
 Log::~Log() {
-    if (logFile.is_open()) {
-        logFile.close();
+    if (!childPartial.empty()) {
+        relay("\n");
     }
+    stopping.store(true, std::memory_order_release);
+    wakeups.fetch_add(1, std::memory_order_release);
+    wakeups.notify_one();
+    flusher.join();
+    close(logFd);
+}
+
+void Log::appendLine(const char* carried, const char* data, size_t len, const struct timespec& now) {
+    if (now.tv_sec != cachedSecond) {
+        // localtime_r/strftime only once per second
+        struct tm nowTm;
+        localtime_r(&now.tv_sec, &nowTm);
+        prefixLen = strftime(prefix, sizeof(prefix), "[%Y-%m-%d %H:%M:%S.", &nowTm);
+        cachedSecond = now.tv_sec;
+    }
+    long millis = now.tv_nsec / 1000000;
+    char stamp[6] = {char('0' + millis / 100), char('0' + millis / 10 % 10), char('0' + millis % 10), ']', ' '};
+    staging.append(prefix, prefixLen);
+    staging.append(stamp, 5);
+    if (carried) staging.append(carried);
+    staging.append(data, len);
+    staging.push_back('\n');
 }
 
 void Log::LOGE(const std::string& message) {
-    std::lock_guard<std::mutex> lock(logMutex);
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    time_t nowTime = tv.tv_sec;
-    struct tm *nowTm = localtime(&nowTime);
-    char timeStr[64];
-    strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", nowTm);
-    // Write time-tagged message to log file
-    logFile << "[" << timeStr << "." << tv.tv_usec/1000 << "] " << message;
-}
\ No newline at end of file
+    write(message, nullptr);
+}
+
+void Log::relay(const std::string& data) {
+    write(data, &childPartial);
+}
+
+void Log::write(const std::string& message, std::string* carry) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    std::lock_guard<std::mutex> lock(producers);
+    staging.clear();
+    const char* data = message.data();
+    const char* end = data + message.size();
+    while (data < end) {
+        const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+        if (!newline) {
+            if (carry) {
+                carry->append(data, end - data);
+            } else {
+                // A runner message is a whole record even without its newline
+                appendLine(nullptr, data, end - data, now);
+            }
+            break;
+        }
+        appendLine(carry ? carry->c_str() : nullptr, data, newline - data, now);
+        if (carry) carry->clear();
+        data = newline + 1;
+    }
+    if (!staging.empty()) {
+        push(staging.data(), staging.size());
+    }
+}
+
+void Log::push(const char* data, size_t len) {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    while (len > 0) {
+        uint64_t t = tail.load(std::memory_order_acquire);
+        uint64_t freeBytes = kRingSize - (h - t);
+        if (freeBytes == 0) {
+            // Disk is behind: publish what we have and sleep until the
+            // flusher moves tail
+            head.store(h, std::memory_order_release);
+            wakeups.fetch_add(1, std::memory_order_release);
+            wakeups.notify_one();
+            tail.wait(t, std::memory_order_acquire);
+            continue;
+        }
+        size_t offset = h & (kRingSize - 1);
+        size_t chunk = std::min<uint64_t>({len, freeBytes, kRingSize - offset});
+        memcpy(ring.data() + offset, data, chunk);
+        data += chunk;
+        len -= chunk;
+        h += chunk;
+    }
+    head.store(h, std::memory_order_release);
+    wakeups.fetch_add(1, std::memory_order_release);
+    wakeups.notify_one();
+}
+
+void Log::run() {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    while (true) {
+        uint32_t seen = wakeups.load(std::memory_order_acquire);
+        uint64_t h = head.load(std::memory_order_acquire);
+        if (h == t) {
+            if (stopping.load(std::memory_order_acquire)) break;
+            wakeups.wait(seen, std::memory_order_acquire);
+            continue;
+        }
+
+        // Everything pending in one writev, split at the wrap point
+        size_t offset = t & (kRingSize - 1);
+        size_t len = h - t;
+        struct iovec iov[2];
+        int iovcnt = 1;
+        iov[0].iov_base = ring.data() + offset;
+        iov[0].iov_len = std::min(len, kRingSize - offset);
+        if (iov[0].iov_len < len) {
+            iov[1].iov_base = ring.data();
+            iov[1].iov_len = len - iov[0].iov_len;
+            iovcnt = 2;
+        }
+        ssize_t written = writev(logFd, iov, iovcnt);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            // Nothing sensible left to do with the log; drop the batch
+            written = len;
+        }
+        t += written;
+        tail.store(t, std::memory_order_release);
+        // A producer may be waiting for space
+        tail.notify_one();
+    }
+}
@@ -6,18 +6,54 @@
 #define LOG_H
 
 #include <string>
-#include <fstream>
+#include <atomic>
 #include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <ctime>
 
+// Asynchronous line-framed logger. Input is split into whole lines, each
+// stamped, and the batch is appended to a ring that a background thread
+// drains to the log file with writev(). Producers serialize on a short mutex
+// around formatting and the ring append; a producer that finds the ring full
+// sleeps until the flusher frees space.
+//
+// The runner's own messages (LOGE) are complete records: a missing trailing
+// newline is supplied. The child's stderr (relay) arrives in arbitrary pipe
+// chunks, so its trailing partial line is carried over until its newline (or
+// the destructor) arrives. The two never share a line.
 class Log {
 public:
     Log(const std::string& logFileName);
     ~Log();
+    // A runner message; safe to call from any thread.
     void LOGE(const std::string& message);
+    // A raw chunk of the child's stderr.
+    void relay(const std::string& data);
 
 private:
-    std::ofstream logFile;
-    std::mutex logMutex;
+    static constexpr size_t kRingSize = 1 << 20;
+
+    int logFd;
+    std::vector<char> ring;
+    std::atomic<uint64_t> head{0};      // advanced by the producer
+    std::atomic<uint64_t> tail{0};      // advanced by the flusher, waited on when full
+    std::atomic<uint32_t> wakeups{0};
+    std::atomic<bool> stopping{false};
+    std::thread flusher;
+
+    std::mutex producers;               // guards everything below and head
+    std::string childPartial;           // incomplete child stderr line carried over
+    std::string staging;                // formatted batch for one call
+    time_t cachedSecond = -1;
+    char prefix[32];                    // "[YYYY-mm-dd HH:MM:SS."
+    size_t prefixLen = 0;
+
+    void appendLine(const char* carried, const char* data, size_t len, const struct timespec& now);
+    void write(const std::string& data, std::string* carry);
+    void push(const char* data, size_t len);
+    void run();
 };
 
-#endif // LOG_H
\ No newline at end of file
+#endif // LOG_H
@@ -0,0 +1,108 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#include "perf.h"
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+long perfEventOpen(struct perf_event_attr* attr, pid_t pid, int groupFd) {
+    return syscall(SYS_perf_event_open, attr, pid, -1, groupFd, PERF_FLAG_FD_CLOEXEC);
+}
+
+bool userOnly() {
+    // paranoid >= 2 only allows user-space measurement for unprivileged users
+    std::ifstream in("/proc/sys/kernel/perf_event_paranoid");
+    int level = 2;
+    in >> level;
+    return level >= 2 && geteuid() != 0;
+}
+}
+
+PerfCounters::PerfCounters(const Args& args, Log& log) : args(args), log(log) {}
+
+PerfCounters::~PerfCounters() {
+    for (auto& counter : counters) {
+        close(counter.fd);
+    }
+}
+
+int PerfCounters::openGroup(uint32_t type, const std::vector<std::pair<const char*, uint64_t>>& events) {
+    bool excludeKernel = userOnly();
+    int leader = -1;
+    int opened = 0;
+    for (const auto& [name, config] : events) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.inherit = 1;
+        attr.exclude_kernel = excludeKernel;
+        attr.exclude_hv = excludeKernel;
+        if (leader < 0) {
+            // Members follow the leader, which starts counting when the
+            // inheriting child execs; our own copy stays disabled
+            attr.disabled = 1;
+            attr.enable_on_exec = 1;
+        }
+        // pid 0: this thread, and every child it creates from now on
+        int fd = perfEventOpen(&attr, 0, leader);
+        if (fd < 0) {
+            if (leader < 0) return 0;
+            continue;
+        }
+        if (leader < 0) leader = fd;
+        counters.push_back({name, fd});
+        opened++;
+    }
+    return opened;
+}
+
+void PerfCounters::prepare() {
+    if (!enabled()) return;
+
+    int hardware = openGroup(PERF_TYPE_HARDWARE, {
+        {"cycles", PERF_COUNT_HW_CPU_CYCLES},
+        {"instructions", PERF_COUNT_HW_INSTRUCTIONS},
+        {"cache-references", PERF_COUNT_HW_CACHE_REFERENCES},
+        {"cache-misses", PERF_COUNT_HW_CACHE_MISSES},
+        {"branches", PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+        {"branch-misses", PERF_COUNT_HW_BRANCH_MISSES},
+    });
+    int software = openGroup(PERF_TYPE_SOFTWARE, {
+        {"task-clock", PERF_COUNT_SW_TASK_CLOCK},
+        {"page-faults", PERF_COUNT_SW_PAGE_FAULTS},
+        {"context-switches", PERF_COUNT_SW_CONTEXT_SWITCHES},
+        {"cpu-migrations", PERF_COUNT_SW_CPU_MIGRATIONS},
+    });
+    if (hardware == 0) {
+        log.LOGE(software > 0 ? "Perf: hardware counters unavailable, using software events\n"
+                              : "Perf: perf_event_open unavailable, counters disabled\n");
+    }
+}
+
+void PerfCounters::collect(Result& result) {
+    for (const auto& counter : counters) {
+        // value, time_enabled, time_running
+        uint64_t values[3];
+        if (read(counter.fd, values, sizeof(values)) != sizeof(values)) continue;
+        double value = values[0];
+        if (values[2] == 0) {
+            // Never scheduled on the PMU: a zero here is not a measurement
+            value = NAN;
+        } else if (values[2] < values[1]) {
+            // Multiplexed with other groups: extrapolate to the enabled time
+            value = value * values[1] / values[2];
+            log.LOGE(std::string("Perf: ") + counter.name + " counted " +
+                     std::to_string(values[2] * 100 / values[1]) + "% of the time, scaled\n");
+        }
+        result.perfCounters.emplace_back(counter.name, value);
+    }
+}
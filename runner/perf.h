@@ -0,0 +1,48 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#ifndef PERF_H
+#define PERF_H
+
+#include "args.h"
+#include "log.h"
+#include "result.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// perf_event_open counters for the child. The counters are opened on the
+// runner's own thread before the child is created, disabled, with inherit
+// and enable_on_exec: the child inherits them at fork/spawn and they start
+// counting when it execs, while the runner's copy never runs. The child's
+// totals are folded back into our fds when it exits. No code has to run in
+// the child, so the posix_spawn path stays available. Hardware events fall
+// back to software events where the PMU is not exposed (VMs/containers).
+class PerfCounters {
+public:
+    PerfCounters(const Args& args, Log& log);
+    ~PerfCounters();
+
+    bool enabled() const { return args.perf; }
+    // Parent, before fork/spawn: open the inherited counter groups.
+    void prepare();
+    // Parent, after wait4. Multiplexed counters are scaled to the enabled
+    // time; one that never ran is reported as NaN ("not counted").
+    void collect(Result& result);
+
+private:
+    struct Counter {
+        const char* name;
+        int fd;
+    };
+
+    const Args& args;
+    Log& log;
+    std::vector<Counter> counters;
+
+    int openGroup(uint32_t type, const std::vector<std::pair<const char*, uint64_t>>& events);
+};
+
+#endif // PERF_H
@@ -0,0 +1,122 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#include "progress.h"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+constexpr double kRefreshMs = 250;
+}
+
+Progress::Progress(const Args& args, Log& log) : args(args), log(log) {}
+
+Progress::~Progress() {
+    if (block) munmap(block, sizeof(TelemetryBlock));
+    if (memFd >= 0) close(memFd);
+}
+
+double Progress::nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+void Progress::prepare() {
+    if (!enabled()) return;
+
+    // CLOEXEC until the child clears it on its own copy (childFd())
+    memFd = memfd_create("sandboxer-telemetry", MFD_CLOEXEC);
+    if (memFd < 0 || ftruncate(memFd, sizeof(TelemetryBlock)) != 0) {
+        log.LOGE("Telemetry: memfd_create failed, progress disabled\n");
+        return;
+    }
+    void* mapping = mmap(nullptr, sizeof(TelemetryBlock), PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+    if (mapping == MAP_FAILED) {
+        log.LOGE("Telemetry: mmap failed, progress disabled\n");
+        return;
+    }
+    // The memfd is zero-filled; construct the atomics in place
+    block = new (mapping) TelemetryBlock();
+    block->magic = kTelemetryMagic;
+    block->version = kTelemetryVersion;
+
+    setenv(kTelemetryEnv, std::to_string(memFd).c_str(), 1);
+    live = isatty(STDERR_FILENO);
+}
+
+void Progress::applyInChild() const {
+    if (childFd() >= 0) fcntl(childFd(), F_SETFD, 0);
+}
+
+void Progress::startParent() {
+    if (!block) return;
+    unsetenv(kTelemetryEnv);
+    nextMs = nowMs() + kRefreshMs;
+}
+
+int Progress::timeoutMs() const {
+    if (!block) return -1;
+    double remaining = nextMs - nowMs();
+    return remaining > 0 ? static_cast<int>(remaining + 0.5) : 0;
+}
+
+void Progress::poll() {
+    if (!block) return;
+    double now = nowMs();
+    if (now < nextMs) return;
+    drainEvents();
+    if (live) draw(false);
+    nextMs = now + kRefreshMs;
+}
+
+void Progress::drainEvents() {
+    uint64_t tail = block->eventTail.load(std::memory_order_relaxed);
+    uint64_t head = block->eventHead.load(std::memory_order_acquire);
+    for (; tail != head; ++tail) {
+        const TelemetryEvent& e = block->events[tail & (kTelemetryEvents - 1)];
+        std::string text(e.text, strnlen(e.text, sizeof(e.text)));
+        if (e.type == kEventPhase) {
+            phase = text;
+            log.LOGE("Telemetry: phase " + text + "\n");
+        } else {
+            log.LOGE("Telemetry: " + text + " " + std::to_string(e.value) + "\n");
+        }
+    }
+    block->eventTail.store(tail, std::memory_order_release);
+}
+
+void Progress::draw(bool final) {
+    char line[160];
+    snprintf(line, sizeof(line), "\r[%s] parsed %lu, inserted %lu, rejected %lu, %.1f MB",
+             phase.empty() ? "-" : phase.c_str(),
+             static_cast<unsigned long>(block->counters[kRowsParsed].load(std::memory_order_relaxed)),
+             static_cast<unsigned long>(block->counters[kRowsInserted].load(std::memory_order_relaxed)),
+             static_cast<unsigned long>(block->counters[kRowsRejected].load(std::memory_order_relaxed)),
+             block->counters[kBytesConsumed].load(std::memory_order_relaxed) / 1e6);
+    std::cerr << line << (final ? "\n" : "") << std::flush;
+}
+
+void Progress::finish(Result& result) {
+    if (!block) return;
+    drainEvents();
+    bool used = block->phase.load(std::memory_order_relaxed) > 0;
+    for (uint32_t i = 0; i < kTelemetryCounters; ++i) {
+        used = used || block->counters[i].load(std::memory_order_relaxed) > 0;
+    }
+    if (!used) return;
+
+    if (live) draw(true);
+    result.telemetryPhase = phase;
+    for (uint32_t i = 0; i < kTelemetryCounters; ++i) {
+        result.telemetryCounters.emplace_back(telemetryCounterName(i),
+                                              block->counters[i].load(std::memory_order_relaxed));
+    }
+}
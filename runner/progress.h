@@ -0,0 +1,51 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include "args.h"
+#include "log.h"
+#include "result.h"
+#include "telemetry.h"
+#include <string>
+
+// Runner side of the shared-memory telemetry channel (telemetry.h). Creates
+// the memfd the child inherits, then reads the counter block and drains the
+// event ring from the App event loop to show live progress on a terminal.
+class Progress {
+public:
+    Progress(const Args& args, Log& log);
+    ~Progress();
+
+    bool enabled() const { return args.telemetry; }
+    // Parent, before fork: create the block and export its fd to the child.
+    void prepare();
+    // The fd the child must keep across exec, -1 when disabled. It is
+    // created close-on-exec; only the child's copy has the flag cleared.
+    int childFd() const { return block ? memFd : -1; }
+    // Child, before exec (fork path).
+    void applyInChild() const;
+    // Parent, after fork: stop exporting the fd to anything else we start.
+    void startParent();
+    // Milliseconds until the next refresh, -1 when disabled.
+    int timeoutMs() const;
+    void poll();
+    void finish(Result& result);
+
+private:
+    const Args& args;
+    Log& log;
+    int memFd = -1;
+    TelemetryBlock* block = nullptr;
+    std::string phase;
+    double nextMs = 0;
+    bool live = false;      // redraw a status line on stderr
+
+    void drainEvents();
+    void draw(bool final);
+    static double nowMs();
+};
+
+#endif // PROGRESS_H
@@ -0,0 +1,78 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#include "protocol.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+constexpr uint32_t kMaxPayload = 16 << 20;
+
+bool sendAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool recvAll(int fd, char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+}
+
+bool Protocol::writeFrame(int fd, char type, const std::string& payload) {
+    char header[5];
+    uint32_t len = payload.size();
+    header[0] = type;
+    memcpy(header + 1, &len, sizeof(len));
+    return sendAll(fd, header, sizeof(header)) && sendAll(fd, payload.data(), payload.size());
+}
+
+bool Protocol::readFrame(int fd, char& type, std::string& payload) {
+    char header[5];
+    if (!recvAll(fd, header, sizeof(header))) return false;
+    uint32_t len;
+    memcpy(&len, header + 1, sizeof(len));
+    if (len > kMaxPayload) return false;
+    type = header[0];
+    payload.resize(len);
+    return recvAll(fd, payload.data(), len);
+}
+
+std::string Protocol::encode(const std::vector<std::string>& fields) {
+    std::string payload;
+    for (const auto& field : fields) {
+        payload += field;
+        payload.push_back('\0');
+    }
+    return payload;
+}
+
+std::vector<std::string> Protocol::decode(const std::string& payload) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (start < payload.size()) {
+        size_t end = payload.find('\0', start);
+        if (end == std::string::npos) end = payload.size();
+        fields.push_back(payload.substr(start, end - start));
+        start = end + 1;
+    }
+    return fields;
+}
@@ -0,0 +1,28 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <string>
+#include <vector>
+
+// Framing for the runner daemon socket: one type byte, a 32-bit payload
+// length in host order (the socket is local), then the payload.
+class Protocol {
+public:
+    static constexpr char kRequest = 'A';   // NUL-separated cwd + runner args
+    static constexpr char kOutput = 'O';    // human-readable statistics
+    static constexpr char kStats = 'S';     // JSON statistics
+    static constexpr char kError = 'E';     // job could not be run
+
+    static bool writeFrame(int fd, char type, const std::string& payload);
+    // Returns false on EOF or a short read.
+    static bool readFrame(int fd, char& type, std::string& payload);
+
+    static std::string encode(const std::vector<std::string>& fields);
+    static std::vector<std::string> decode(const std::string& payload);
+};
+
+#endif // PROTOCOL_H
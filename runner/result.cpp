@@ -4,9 +4,239 @@
 
 #include "result.h"
 #include <iostream>
+#include <iomanip>
+#include <iterator>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <sys/wait.h>
 
-void Result::print() {
-    std::cout << "User CPU Time: " << userCPUTime << " sec\n";
-    std::cout << "System CPU Time: " << systemCPUTime << " sec\n";
-    std::cout << "Maximum Resident Set Size: " << maxRSS << " KB\n";
-}
\ No newline at end of file
+namespace {
+double counter(const std::vector<std::pair<std::string, double>>& counters, const std::string& name) {
+    for (const auto& [key, value] : counters) {
+        if (key == name) return value;
+    }
+    return 0;
+}
+
+// Reader for the flat object writeJson produces: string and number values
+// plus the one-level "telemetry" and "perf" counter objects.
+class JsonReader {
+public:
+    explicit JsonReader(std::string text) : text(std::move(text)) {}
+
+    bool consume(char c) {
+        skipSpace();
+        if (pos < text.size() && text[pos] == c) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    bool peek(char c) {
+        skipSpace();
+        return pos < text.size() && text[pos] == c;
+    }
+
+    bool string(std::string& out) {
+        if (!consume('"')) return false;
+        out.clear();
+        while (pos < text.size() && text[pos] != '"') {
+            if (text[pos] == '\\' && pos + 1 < text.size()) ++pos;
+            out += text[pos++];
+        }
+        return consume('"');
+    }
+
+    bool number(double& out) {
+        skipSpace();
+        const char* start = text.c_str() + pos;
+        char* end;
+        out = strtod(start, &end);
+        pos += end - start;
+        return end != start;
+    }
+
+    // true, false or null
+    bool word(std::string& out) {
+        skipSpace();
+        out.clear();
+        while (pos < text.size() && isalpha(static_cast<unsigned char>(text[pos]))) out += text[pos++];
+        return !out.empty();
+    }
+
+    bool counters(std::vector<std::pair<std::string, double>>& out) {
+        out.clear();
+        if (!consume('{')) return false;
+        if (consume('}')) return true;
+        do {
+            std::string name, none;
+            double value;
+            if (!string(name) || !consume(':')) return false;
+            if (!number(value)) {
+                // null: a perf counter that was never scheduled
+                if (!word(none) || none != "null") return false;
+                value = NAN;
+            }
+            out.emplace_back(name, value);
+        } while (consume(','));
+        return consume('}');
+    }
+
+private:
+    std::string text;
+    size_t pos = 0;
+
+    void skipSpace() {
+        while (pos < text.size() && isspace(static_cast<unsigned char>(text[pos]))) ++pos;
+    }
+};
+}
+
+void Result::print(std::ostream& out) const {
+    out << "Wall Clock Time: " << wallTime << " sec\n";
+    out << "User CPU Time: " << userCPUTime << " sec\n";
+    out << "System CPU Time: " << systemCPUTime << " sec\n";
+    out << "Maximum Resident Set Size: " << maxRSS << " KB\n";
+    out << "Peak Memory: " << peakMemory / 1024 << " KB\n";
+    if (throttledTime > 0) {
+        out << "CPU Throttled Time: " << throttledTime << " sec\n";
+    }
+    if (cached) {
+        out << "Result Cache: hit, statistics are from the original run\n";
+    }
+    if (stdinBytes > 0) {
+        out << "Stdin Bytes: " << stdinBytes << "\n";
+    }
+    if (samples > 0) {
+        out << "Samples: " << samples << " (overhead " << samplerOverhead * 1e3 << " ms)\n";
+        out << "RSS p50/p95: " << rssP50 << " / " << rssP95 << " KB\n";
+        out << "CPU p50/p95: " << cpuP50 << " / " << cpuP95 << " %\n";
+        out << "I/O Stall Samples: " << ioStallSamples << "\n";
+    }
+    if (!telemetryCounters.empty()) {
+        out << "Telemetry (phase " << (telemetryPhase.empty() ? "-" : telemetryPhase) << "):\n";
+        for (const auto& [name, value] : telemetryCounters) {
+            out << "  " << std::left << std::setw(18) << name << std::right
+                << std::fixed << std::setprecision(0) << value << "\n";
+        }
+        out.unsetf(std::ios::floatfield);
+        out << std::setprecision(6);
+    }
+    if (!perfCounters.empty()) {
+        out << "Perf Counters:\n";
+        for (const auto& [name, value] : perfCounters) {
+            out << "  " << std::left << std::setw(18) << name << std::right;
+            if (std::isnan(value)) {
+                out << "not counted\n";
+            } else {
+                out << std::fixed << std::setprecision(0) << value << "\n";
+            }
+        }
+        out.unsetf(std::ios::floatfield);
+        out << std::setprecision(6);
+        double cycles = counter(perfCounters, "cycles");
+        double instructions = counter(perfCounters, "instructions");
+        if (cycles > 0 && !std::isnan(instructions)) {
+            out << "  IPC: " << instructions / cycles << "\n";
+        }
+    }
+    if (!limitHit.empty()) {
+        out << "Limit Exceeded: " << limitHit << "\n";
+    }
+}
+
+void Result::writeJson(std::ostream& out) const {
+    out << "{\n"
+        << "  \"wallTime\": " << wallTime << ",\n"
+        << "  \"userCPUTime\": " << userCPUTime << ",\n"
+        << "  \"systemCPUTime\": " << systemCPUTime << ",\n"
+        << "  \"maxRSS\": " << maxRSS << ",\n"
+        << "  \"exitCode\": " << (WIFEXITED(exitStatus) ? WEXITSTATUS(exitStatus) : -1) << ",\n"
+        << "  \"termSignal\": " << (WIFSIGNALED(exitStatus) ? WTERMSIG(exitStatus) : 0) << ",\n"
+        << "  \"limitHit\": \"" << limitHit << "\",\n"
+        << "  \"peakMemory\": " << peakMemory << ",\n"
+        << "  \"throttledTime\": " << throttledTime << ",\n"
+        << "  \"stdinBytes\": " << stdinBytes << ",\n"
+        << "  \"cached\": " << (cached ? "true" : "false") << ",\n"
+        << "  \"samples\": " << samples << ",\n"
+        << "  \"rssP50\": " << rssP50 << ",\n"
+        << "  \"rssP95\": " << rssP95 << ",\n"
+        << "  \"cpuP50\": " << cpuP50 << ",\n"
+        << "  \"cpuP95\": " << cpuP95 << ",\n"
+        << "  \"ioStallSamples\": " << ioStallSamples << ",\n"
+        << "  \"samplerOverhead\": " << samplerOverhead << ",\n"
+        << "  \"telemetryPhase\": \"" << telemetryPhase << "\",\n"
+        << "  \"telemetry\": {";
+    for (size_t i = 0; i < telemetryCounters.size(); ++i) {
+        out << (i ? ", " : "") << "\"" << telemetryCounters[i].first << "\": "
+            << std::fixed << std::setprecision(0) << telemetryCounters[i].second;
+    }
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6) << "},\n"
+        << "  \"perf\": {";
+    for (size_t i = 0; i < perfCounters.size(); ++i) {
+        out << (i ? ", " : "") << "\"" << perfCounters[i].first << "\": ";
+        if (std::isnan(perfCounters[i].second)) {
+            out << "null";
+        } else {
+            out << std::fixed << std::setprecision(0) << perfCounters[i].second;
+        }
+    }
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6) << "}\n}\n";
+}
+
+bool Result::readJson(std::istream& in) {
+    JsonReader reader(std::string(std::istreambuf_iterator<char>(in), {}));
+    if (!reader.consume('{')) return false;
+
+    int exitCode = 0, termSignal = 0;
+    do {
+        std::string key;
+        if (!reader.string(key) || !reader.consume(':')) return false;
+        if (key == "telemetry") {
+            if (!reader.counters(telemetryCounters)) return false;
+            continue;
+        }
+        if (key == "perf") {
+            if (!reader.counters(perfCounters)) return false;
+            continue;
+        }
+        if (reader.peek('"')) {
+            std::string value;
+            if (!reader.string(value)) return false;
+            if (key == "limitHit") limitHit = value;
+            else if (key == "telemetryPhase") telemetryPhase = value;
+            continue;
+        }
+        std::string word;
+        if (reader.word(word)) {
+            if (key == "cached") cached = word == "true";
+            continue;
+        }
+        double value;
+        if (!reader.number(value)) return false;
+        if (key == "wallTime") wallTime = value;
+        else if (key == "userCPUTime") userCPUTime = value;
+        else if (key == "systemCPUTime") systemCPUTime = value;
+        else if (key == "maxRSS") maxRSS = value;
+        else if (key == "exitCode") exitCode = value;
+        else if (key == "termSignal") termSignal = value;
+        else if (key == "peakMemory") peakMemory = value;
+        else if (key == "throttledTime") throttledTime = value;
+        else if (key == "stdinBytes") stdinBytes = value;
+        else if (key == "samples") samples = value;
+        else if (key == "rssP50") rssP50 = value;
+        else if (key == "rssP95") rssP95 = value;
+        else if (key == "cpuP50") cpuP50 = value;
+        else if (key == "cpuP95") cpuP95 = value;
+        else if (key == "ioStallSamples") ioStallSamples = value;
+        else if (key == "samplerOverhead") samplerOverhead = value;
+    } while (reader.consume(','));
+
+    // The same encoding wait4 uses
+    exitStatus = termSignal > 0 ? termSignal : (exitCode & 0xff) << 8;
+    return reader.consume('}');
+}
@@ -5,14 +5,49 @@
 #ifndef RESULT_H
 #define RESULT_H
 
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
 class Result {
 public:
-    void print();
+    void print(std::ostream& out = std::cout) const;
+    void writeJson(std::ostream& out) const;
+    // Loads what writeJson wrote; false if the text is not in that format.
+    bool readJson(std::istream& in);
 
     // Profiling info
+    double wallTime = 0;         // fork to wait4, seconds
     double userCPUTime;
     double systemCPUTime;
     long maxRSS;
+
+    // Resource budget accounting
+    int exitStatus = 0;          // raw wait4 status
+    std::string limitHit;        // "memory", "cpu-time", "files", "output" or empty
+    long peakMemory = 0;         // bytes, memory.peak when under cgroup
+    double throttledTime = 0;    // seconds, cpu.stat throttled_usec
+
+    // Sampler summary
+    long samples = 0;
+    long rssP50 = 0;             // KB
+    long rssP95 = 0;             // KB
+    double cpuP50 = 0;           // percent of one CPU
+    double cpuP95 = 0;
+    long ioStallSamples = 0;     // samples taken in uninterruptible sleep
+    double samplerOverhead = 0;  // runner CPU seconds spent sampling
+
+    long stdinBytes = 0;         // streamed into the child's stdin
+    bool cached = false;         // restored from the result cache, not run
+
+    // Counters the child published over the telemetry channel
+    std::string telemetryPhase;
+    std::vector<std::pair<std::string, double>> telemetryCounters;
+
+    // perf_event_open counters, in the order they were opened; NaN when the
+    // PMU never scheduled the counter (printed "not counted", JSON null)
+    std::vector<std::pair<std::string, double>> perfCounters;
 };
 
 #endif // RESULT_H
\ No newline at end of file
@@ -2,7 +2,12 @@
 #include "log.h"
 #include "app.h"
 #include "result.h"
+#include "bench.h"
+#include "cache.h"
+#include "server.h"
+#include "client.h"
 #include <iostream>
+#include <fstream>
 
 int main(int argc, char* argv[]) {
     try {
@@ -12,10 +17,41 @@ int main(int argc, char* argv[]) {
         }
 
         Args args(argc, argv);
-        Log log(args.logFileName);
-        App app(args, log);
-        app.run();
-        app.result.print();
+        if (!args.serveSocket.empty()) {
+            Server server(args);
+            server.run();
+            return 0;
+        }
+        if (!args.connectSocket.empty()) {
+            Client client(args);
+            client.run();
+            return 0;
+        }
+
+        if (Bench::requested(args)) {
+            Log log(args.logFileName);
+            Bench bench(args, log);
+            bench.run();
+            return 0;
+        }
+
+        Result result;
+        ResultCache cache(args);
+        if (!cache.restore(result)) {
+            {
+                // Log is flushed by its destructor before the cache copies it
+                Log log(args.logFileName);
+                App app(args, log);
+                app.run();
+                result = app.result;
+            }
+            cache.store(result);
+        }
+        result.print();
+        if (!args.statsFileName.empty()) {
+            std::ofstream stats(args.statsFileName);
+            result.writeJson(stats);
+        }
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
         Args::printUsage();
@@ -0,0 +1,170 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#include "sampler.h"
+#include "stats.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace {
+constexpr double kMinIntervalMs = 10;
+// Sampling may use at most this fraction of the interval before backing off
+constexpr double kMaxOverhead = 0.02;
+
+long fieldAfter(const char* text, const char* key) {
+    const char* p = strstr(text, key);
+    return p ? strtol(p + strlen(key), nullptr, 10) : 0;
+}
+}
+
+Sampler::Sampler(const Args& args, Log& log) : args(args), log(log) {}
+
+Sampler::~Sampler() {
+    for (int fd : {statFd, statusFd, ioFd, schedstatFd}) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+double Sampler::nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+ssize_t Sampler::readProc(int fd, char* buffer, size_t size) {
+    if (fd < 0) return -1;
+    ssize_t n = pread(fd, buffer, size - 1, 0);
+    buffer[n > 0 ? n : 0] = '\0';
+    return n;
+}
+
+void Sampler::start(pid_t pid) {
+    if (!enabled()) return;
+
+    out.open(args.sampleFileName);
+    if (!out.is_open()) {
+        log.LOGE("Sampler: cannot open " + args.sampleFileName + "\n");
+        return;
+    }
+    out << "time_ms,rss_kb,cpu_pct,read_bytes,write_bytes,vol_cs,invol_cs,minflt,majflt,state\n";
+
+    std::string proc = "/proc/" + std::to_string(pid) + "/";
+    statFd = open((proc + "stat").c_str(), O_RDONLY | O_CLOEXEC);
+    statusFd = open((proc + "status").c_str(), O_RDONLY | O_CLOEXEC);
+    ioFd = open((proc + "io").c_str(), O_RDONLY | O_CLOEXEC);
+    schedstatFd = open((proc + "schedstat").c_str(), O_RDONLY | O_CLOEXEC);
+
+    pageKB = sysconf(_SC_PAGESIZE) / 1024;
+    clockTicks = sysconf(_SC_CLK_TCK);
+    intervalMs = std::max<double>(args.sampleIntervalMs, kMinIntervalMs);
+    startMs = lastMs = nowMs();
+    nextMs = startMs;
+    poll();
+}
+
+int Sampler::timeoutMs() const {
+    if (statFd < 0) return -1;
+    double remaining = nextMs - nowMs();
+    return remaining > 0 ? static_cast<int>(remaining + 0.5) : 0;
+}
+
+void Sampler::poll() {
+    if (statFd < 0) return;
+    double now = nowMs();
+    if (now < nextMs) return;
+
+    struct timespec before, after;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &before);
+    take();
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &after);
+    overheadSec += (after.tv_sec - before.tv_sec) + (after.tv_nsec - before.tv_nsec) / 1e9;
+
+    // take() may record nothing (child gone, unparsable stat line)
+    if (!samples.empty()) {
+        double meanCostMs = overheadSec * 1e3 / samples.size();
+        if (meanCostMs > intervalMs * kMaxOverhead) {
+            intervalMs *= 2;
+            log.LOGE("Sampler: overhead above budget, interval raised to " +
+                     std::to_string(static_cast<long>(intervalMs)) + " ms\n");
+        }
+    }
+    // Advanced on every path, so a failed take() cannot make the loop spin.
+    // Missed ticks are skipped instead of bursting to catch up.
+    while (nextMs <= now) nextMs += intervalMs;
+}
+
+void Sampler::take() {
+    char buffer[4096];
+    Sample s = {};
+    double now = nowMs();
+    s.timeMs = now - startMs;
+
+    if (readProc(statFd, buffer, sizeof(buffer)) <= 0) {
+        // Child is gone
+        close(statFd);
+        statFd = -1;
+        return;
+    }
+    // Fields after the parenthesised command name, starting at field 3
+    const char* p = strrchr(buffer, ')');
+    if (!p) return;
+    long fields[22] = {};
+    s.state = p[2];
+    char* cursor = const_cast<char*>(p + 3);
+    for (int i = 1; i < 22; ++i) {
+        fields[i] = strtol(cursor, &cursor, 10);
+    }
+    s.minorFaults = fields[7];
+    s.majorFaults = fields[9];
+    s.rssKB = fields[21] * pageKB;
+    double cpuNs = (fields[11] + fields[12]) * 1e9 / clockTicks;
+
+    if (readProc(schedstatFd, buffer, sizeof(buffer)) > 0) {
+        // Nanosecond on-CPU time, much finer than clock ticks
+        cpuNs = strtod(buffer, nullptr);
+    }
+    if (lastRunNs >= 0 && now > lastMs) {
+        s.cpuPercent = (cpuNs - lastRunNs) / ((now - lastMs) * 1e4);
+    }
+    lastRunNs = cpuNs;
+    lastMs = now;
+
+    if (readProc(statusFd, buffer, sizeof(buffer)) > 0) {
+        s.voluntarySwitches = fieldAfter(buffer, "\nvoluntary_ctxt_switches:");
+        s.involuntarySwitches = fieldAfter(buffer, "\nnonvoluntary_ctxt_switches:");
+    }
+    if (readProc(ioFd, buffer, sizeof(buffer)) > 0) {
+        s.readBytes = fieldAfter(buffer, "read_bytes:");
+        s.writeBytes = fieldAfter(buffer, "\nwrite_bytes:");
+    }
+
+    samples.push_back(s);
+    out << static_cast<long>(s.timeMs) << ',' << s.rssKB << ',' << s.cpuPercent << ','
+        << s.readBytes << ',' << s.writeBytes << ',' << s.voluntarySwitches << ','
+        << s.involuntarySwitches << ',' << s.minorFaults << ',' << s.majorFaults << ','
+        << s.state << '\n';
+}
+
+void Sampler::finish(Result& result) {
+    if (!enabled()) return;
+    out.close();
+
+    std::vector<long> rss;
+    std::vector<double> cpu;
+    for (const auto& s : samples) {
+        rss.push_back(s.rssKB);
+        cpu.push_back(s.cpuPercent);
+        if (s.state == 'D') result.ioStallSamples++;
+    }
+    result.samples = samples.size();
+    result.rssP50 = percentile(rss, 0.50);
+    result.rssP95 = percentile(rss, 0.95);
+    result.cpuP50 = percentile(cpu, 0.50);
+    result.cpuP95 = percentile(cpu, 0.95);
+    result.samplerOverhead = overheadSec;
+}
@@ -0,0 +1,64 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "args.h"
+#include "log.h"
+#include "result.h"
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// Periodic /proc sampler for the sandboxed child. Driven from the App event
+// loop: select() waits at most timeoutMs(), then poll() takes a sample when
+// one is due. The /proc files are opened once and re-read with pread().
+class Sampler {
+public:
+    Sampler(const Args& args, Log& log);
+    ~Sampler();
+
+    bool enabled() const { return !args.sampleFileName.empty(); }
+    void start(pid_t pid);
+    // Milliseconds until the next sample is due, -1 when disabled.
+    int timeoutMs() const;
+    void poll();
+    void finish(Result& result);
+
+private:
+    struct Sample {
+        double timeMs;
+        long rssKB;
+        double cpuPercent;
+        long readBytes;
+        long writeBytes;
+        long voluntarySwitches;
+        long involuntarySwitches;
+        long minorFaults;
+        long majorFaults;
+        char state;
+    };
+
+    const Args& args;
+    Log& log;
+    std::ofstream out;
+    std::vector<Sample> samples;
+    int statFd = -1, statusFd = -1, ioFd = -1, schedstatFd = -1;
+    double intervalMs = 0;
+    double startMs = 0;
+    double nextMs = 0;
+    double lastMs = 0;
+    double lastRunNs = -1;
+    double overheadSec = 0;
+    long pageKB = 4;
+    long clockTicks = 100;
+
+    void take();
+    static double nowMs();
+    static ssize_t readProc(int fd, char* buffer, size_t size);
+};
+
+#endif // SAMPLER_H
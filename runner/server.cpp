@@ -0,0 +1,215 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#include "server.h"
+#include "app.h"
+#include "bench.h"
+#include "cache.h"
+#include "log.h"
+#include "protocol.h"
+#include <iostream>
+#include <sstream>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+volatile sig_atomic_t stopRequested = 0;
+
+// A worker that dies sooner than this after its fork is failing at startup
+constexpr double kMinWorkerLifetime = 1.0;
+
+void onStop(int) {
+    stopRequested = 1;
+}
+
+double monotonicSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+}
+
+Server::Server(const Args& args) : args(args) {}
+
+Server::~Server() {
+    if (listenFd >= 0) {
+        close(listenFd);
+        unlink(args.serveSocket.c_str());
+    }
+}
+
+void Server::run() {
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (args.serveSocket.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Error: Socket path too long");
+    }
+    strcpy(addr.sun_path, args.serveSocket.c_str());
+
+    // Replace a stale socket from a previous daemon, but nothing else
+    struct stat st;
+    if (stat(addr.sun_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(addr.sun_path);
+    }
+
+    // Jobs run with the daemon's credentials: only its own user may connect.
+    // The umask covers the window between bind() and chmod().
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    mode_t oldMask = umask(0077);
+    bool bound = listenFd >= 0 &&
+                 bind(listenFd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0;
+    int bindErrno = errno;
+    umask(oldMask);
+    if (!bound || chmod(addr.sun_path, 0600) != 0 || listen(listenFd, SOMAXCONN) != 0) {
+        throw std::runtime_error("Error: Cannot listen on " + args.serveSocket + ": " +
+                                 strerror(bound ? errno : bindErrno));
+    }
+
+    struct sigaction sa = {};
+    sa.sa_handler = onStop;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    // Fork the workers now, while this process is still small
+    long count = args.workers > 0 ? args.workers : sysconf(_SC_NPROCESSORS_ONLN);
+    for (long i = 0; i < count; ++i) {
+        workers.push_back(spawnWorker());
+    }
+    std::cout << "Runner daemon listening on " << args.serveSocket
+              << " with " << count << " workers\n" << std::flush;
+
+    while (!stopRequested) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (auto& worker : workers) {
+            if (worker.pid != pid) continue;
+            // Back off instead of fork-looping on a worker that cannot start;
+            // SIGTERM interrupts the sleep
+            double lived = monotonicSeconds() - worker.started;
+            if (lived < kMinWorkerLifetime) {
+                std::cerr << "Runner daemon: worker " << pid << " exited after "
+                          << lived << "s, restarting in " << kMinWorkerLifetime << "s\n";
+                struct timespec delay = {time_t(kMinWorkerLifetime), 0};
+                nanosleep(&delay, NULL);
+            }
+            if (stopRequested) {
+                worker.pid = -1;
+            } else {
+                worker = spawnWorker();
+            }
+        }
+    }
+
+    for (auto& worker : workers) {
+        if (worker.pid > 0) kill(worker.pid, SIGTERM);
+    }
+    for (auto& worker : workers) {
+        if (worker.pid > 0) waitpid(worker.pid, NULL, 0);
+    }
+}
+
+Server::Worker Server::spawnWorker() {
+    pid_t pid = fork();
+    if (pid < 0) {
+        throw std::runtime_error("Error: Cannot fork daemon worker");
+    }
+    if (pid == 0) {
+        workerLoop();
+    }
+    return {pid, monotonicSeconds()};
+}
+
+void Server::workerLoop() {
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    while (true) {
+        int fd = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            _exit(1);
+        }
+        handleConnection(fd);
+        close(fd);
+    }
+}
+
+void Server::handleConnection(int fd) {
+    char type;
+    std::string payload;
+    if (!Protocol::readFrame(fd, type, payload) || type != Protocol::kRequest) {
+        return;
+    }
+
+    // Checked after the (size-capped) request is read so the client gets the
+    // refusal instead of a failed send
+    struct ucred peer;
+    socklen_t peerLen = sizeof(peer);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &peerLen) != 0 || peer.uid != geteuid()) {
+        Protocol::writeFrame(fd, Protocol::kError, "Error: Connection refused: peer is not the daemon's user");
+        return;
+    }
+
+    std::vector<std::string> fields = Protocol::decode(payload);
+    if (fields.empty() || chdir(fields[0].c_str()) != 0) {
+        Protocol::writeFrame(fd, Protocol::kError, "Error: Cannot enter client working directory");
+        return;
+    }
+
+    // Rebuild an argv for Args, with fields[0] standing in for argv[0]
+    std::vector<char*> argv;
+    for (auto& field : fields) {
+        argv.push_back(field.data());
+    }
+    argv.push_back(NULL);
+
+    try {
+        Args jobArgs(argv.size() - 1, argv.data());
+        if (!jobArgs.serveSocket.empty() || !jobArgs.connectSocket.empty()) {
+            throw std::runtime_error("Error: Nested daemon options are not allowed in a job");
+        }
+        if (Bench::requested(jobArgs)) {
+            throw std::runtime_error("Error: Bench options are not supported through --connect");
+        }
+        // The worker would read its own stdin (or a FIFO meant for the
+        // client's process), not the client's: only regular files travel
+        struct stat st;
+        if (!jobArgs.stdinSource.empty() &&
+            (jobArgs.stdinSource == "-" || stat(jobArgs.stdinSource.c_str(), &st) != 0 || !S_ISREG(st.st_mode))) {
+            throw std::runtime_error("Error: --stdin-from must be a regular file through --connect");
+        }
+
+        Result result;
+        ResultCache cache(jobArgs);
+        if (!cache.restore(result)) {
+            {
+                // Log is flushed by its destructor before the client hears back
+                Log log(jobArgs.logFileName);
+                App app(jobArgs, log);
+                app.run();
+                result = app.result;
+            }
+            cache.store(result);
+        }
+
+        std::ostringstream text, json;
+        result.print(text);
+        result.writeJson(json);
+        Protocol::writeFrame(fd, Protocol::kOutput, text.str());
+        Protocol::writeFrame(fd, Protocol::kStats, json.str());
+    } catch (const std::exception& e) {
+        Protocol::writeFrame(fd, Protocol::kError, e.what());
+    }
+}
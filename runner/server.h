@@ -0,0 +1,39 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "args.h"
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// runner --serve: a master process that binds a Unix socket and pre-forks
+// lean worker processes before any job state exists. Workers accept()
+// directly on the shared socket and run one job at a time through App; the
+// master only restarts workers that die, backing off when they die young.
+// The socket is created 0600 and connections from other users are refused.
+class Server {
+public:
+    Server(const Args& args);
+    ~Server();
+    void run();
+
+private:
+    const Args& args;
+    struct Worker {
+        pid_t pid;
+        double started;                 // CLOCK_MONOTONIC seconds
+    };
+
+    int listenFd = -1;
+    std::vector<Worker> workers;
+
+    Worker spawnWorker();
+    [[noreturn]] void workerLoop();
+    void handleConnection(int fd);
+};
+
+#endif // SERVER_H
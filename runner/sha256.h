@@ -0,0 +1,34 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Streaming SHA-256 (FIPS 180-4), used to key the result cache.
+class Sha256 {
+public:
+    Sha256();
+    void update(const void* data, size_t len);
+    void update(const std::string& text) { update(text.data(), text.size()); }
+    // Finalizes; the object must not be updated afterwards.
+    std::string hexDigest();
+
+    // Digest of a file's contents, empty when it cannot be read.
+    static std::string file(const std::string& path);
+    static std::string hex(const std::string& text);
+
+private:
+    uint32_t state[8];
+    uint8_t block[64];
+    size_t blockLen = 0;
+    uint64_t totalLen = 0;
+
+    void compress(const uint8_t* chunk);
+};
+
+#endif // SHA256_H
@@ -0,0 +1,20 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <algorithm>
+#include <vector>
+
+// Nearest-rank percentile, p in [0, 1]. Takes a copy so callers keep order.
+template <typename T>
+T percentile(std::vector<T> values, double p) {
+    if (values.empty()) return T();
+    size_t idx = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + idx, values.end());
+    return values[idx];
+}
+
+#endif // STATS_H
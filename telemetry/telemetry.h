@@ -0,0 +1,129 @@
+//
+// Created by jesse on 10/16/24.
+//
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+// Header-only client for the runner's shared-memory telemetry channel.
+//
+// The runner creates a memfd holding a TelemetryBlock, leaves it open across
+// exec and puts its fd number in SANDBOXER_TELEMETRY_FD. A child constructs
+// one Telemetry object; when the variable is absent (running outside the
+// runner) every call is a no-op. Updates are plain atomic operations on the
+// shared mapping: no syscalls after construction.
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr const char* kTelemetryEnv = "SANDBOXER_TELEMETRY_FD";
+constexpr uint32_t kTelemetryMagic = 0x54454c31;  // "TEL1"
+constexpr uint32_t kTelemetryVersion = 1;
+constexpr size_t kTelemetryEvents = 256;          // power of two
+
+enum TelemetryCounter : uint32_t {
+    kRowsParsed,
+    kRowsInserted,
+    kRowsRejected,
+    kBytesConsumed,
+    kTelemetryCounters
+};
+
+inline const char* telemetryCounterName(uint32_t counter) {
+    static const char* names[kTelemetryCounters] = {
+        "rowsParsed", "rowsInserted", "rowsRejected", "bytesConsumed"};
+    return counter < kTelemetryCounters ? names[counter] : "unknown";
+}
+
+enum TelemetryEventType : uint32_t {
+    kEventPhase,        // text = new phase name
+    kEventMessage,      // free-form text with a value
+};
+
+struct TelemetryEvent {
+    uint64_t timeNs;    // CLOCK_MONOTONIC
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t value;
+    char text[40];
+};
+
+struct TelemetryBlock {
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint64_t> counters[kTelemetryCounters];
+    std::atomic<uint32_t> phase;    // bumped on every phase change
+    // Single-producer (child) / single-consumer (runner) event ring
+    alignas(64) std::atomic<uint64_t> eventHead;
+    alignas(64) std::atomic<uint64_t> eventTail;
+    alignas(64) TelemetryEvent events[kTelemetryEvents];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "telemetry needs lock-free 64-bit atomics");
+
+class Telemetry {
+public:
+    Telemetry() {
+        const char* env = getenv(kTelemetryEnv);
+        if (!env) return;
+        int fd = atoi(env);
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(TelemetryBlock))) return;
+        void* mapping = mmap(nullptr, sizeof(TelemetryBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) return;
+        block = static_cast<TelemetryBlock*>(mapping);
+        if (block->magic != kTelemetryMagic || block->version != kTelemetryVersion) {
+            munmap(block, sizeof(TelemetryBlock));
+            block = nullptr;
+        }
+    }
+
+    ~Telemetry() {
+        if (block) munmap(block, sizeof(TelemetryBlock));
+    }
+
+    Telemetry(const Telemetry&) = delete;
+    Telemetry& operator=(const Telemetry&) = delete;
+
+    bool active() const { return block != nullptr; }
+
+    void add(TelemetryCounter counter, uint64_t n = 1) {
+        if (block) block->counters[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void setPhase(const char* name) {
+        if (!block) return;
+        block->phase.fetch_add(1, std::memory_order_relaxed);
+        event(kEventPhase, 0, name);
+    }
+
+    // Drops the event (returns false) when the runner has fallen behind.
+    bool event(uint32_t type, uint64_t value, const char* text) {
+        if (!block) return false;
+        uint64_t head = block->eventHead.load(std::memory_order_relaxed);
+        if (head - block->eventTail.load(std::memory_order_acquire) >= kTelemetryEvents) {
+            return false;
+        }
+        TelemetryEvent& e = block->events[head & (kTelemetryEvents - 1)];
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);   // vDSO, not a syscall
+        e.timeNs = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+        e.type = type;
+        e.value = value;
+        strncpy(e.text, text, sizeof(e.text) - 1);
+        e.text[sizeof(e.text) - 1] = '\0';
+        block->eventHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    TelemetryBlock* block = nullptr;
+};
+
+#endif // TELEMETRY_H
@@ -0,0 +1,24 @@
+//
+// Created by jesse on 10/25/24.
+//
+
+#include "schema.h"
+#include <stdexcept>
+
+std::string TradeSchema::storedDate(const std::string& yyyymmdd, const std::string& table) {
+    if (yyyymmdd.length() != 8) {
+        throw std::runtime_error("Date must be in YYYYMMDD format");
+    }
+    if (table == "trades") return yyyymmdd;
+    return yyyymmdd.substr(4, 2) + "-" + yyyymmdd.substr(6, 2) + "-" + yyyymmdd.substr(2, 2);
+}
+
+void TradeSchema::exec(sqlite3* db, const char* sql, const std::string& what) {
+    char* err_msg = nullptr;
+    int rc = sqlite3_exec(db, sql, nullptr, nullptr, &err_msg);
+    if (rc != SQLITE_OK) {
+        std::string error = err_msg ? err_msg : sqlite3_errmsg(db);
+        sqlite3_free(err_msg);
+        throw std::runtime_error(what + ": " + error);
+    }
+}
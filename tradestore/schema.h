@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <sqlite3.h>
+
+// trades.db layout, shared by the csv_to_sqlite writer and TradeStore readers.
+class TradeSchema {
+public:
+    static constexpr const char* kCreateNodes =
+        "CREATE TABLE IF NOT EXISTS nodes ("
+        "    guid TEXT PRIMARY KEY,"
+        "    type TEXT NOT NULL,"
+        "    date TEXT NOT NULL,"
+        "    timestamp TEXT NOT NULL,"
+        "    expiry TEXT NOT NULL,"
+        "    body TEXT NOT NULL"
+        ");";
+
+    // Serves TradeStore range scans by (type, date, time window)
+    static constexpr const char* kCreateScanIndex =
+        "CREATE INDEX IF NOT EXISTS nodes_scan ON nodes (type, date, timestamp);";
+
+    // Clustered on the scan key, written by csv_to_sqlite --sorted. date is
+    // stored as YYYYMMDD so the key sorts chronologically across years; guid
+    // only breaks ties so the key stays unique.
+    static constexpr const char* kCreateTrades =
+        "CREATE TABLE IF NOT EXISTS trades ("
+        "    type TEXT NOT NULL,"
+        "    date TEXT NOT NULL,"
+        "    timestamp TEXT NOT NULL,"
+        "    guid TEXT NOT NULL,"
+        "    expiry TEXT NOT NULL,"
+        "    body TEXT NOT NULL,"
+        "    PRIMARY KEY (type, date, timestamp, guid)"
+        ") WITHOUT ROWID;";
+
+    // The stored DD-Mon-YY expiry as a sortable YYYYMMDD expression
+    static constexpr const char* kExpiryKey =
+        "('20' || substr(expiry, 8, 2) || "
+        "CASE substr(expiry, 4, 3) "
+        "WHEN 'Jan' THEN '01' WHEN 'Feb' THEN '02' WHEN 'Mar' THEN '03' "
+        "WHEN 'Apr' THEN '04' WHEN 'May' THEN '05' WHEN 'Jun' THEN '06' "
+        "WHEN 'Jul' THEN '07' WHEN 'Aug' THEN '08' WHEN 'Sep' THEN '09' "
+        "WHEN 'Oct' THEN '10' WHEN 'Nov' THEN '11' WHEN 'Dec' THEN '12' END || "
+        "substr(expiry, 1, 2))";
+
+    static constexpr const char* kInsertTrade =
+        "INSERT INTO trades (type, date, timestamp, guid, expiry, body) "
+        "VALUES (?, ?, ?, ?, ?, ?);";
+
+    static constexpr const char* kInsertNode =
+        "INSERT INTO nodes (guid, type, date, timestamp, expiry, body) "
+        "VALUES (?, ?, ?, ?, ?, ?);";
+
+    // YYYYMMDD -> the date as stored in table: MM-DD-YY in nodes, unchanged
+    // in trades
+    static std::string storedDate(const std::string& yyyymmdd, const std::string& table);
+
+    // sqlite3_exec that throws std::runtime_error("<what>: <message>")
+    static void exec(sqlite3* db, const char* sql, const std::string& what);
+};
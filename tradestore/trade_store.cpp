@@ -0,0 +1,155 @@
+//
+// Created by jesse on 10/25/24.
+//
+
+#include "trade_store.h"
+#include "schema.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+void RowBatch::clear() {
+    rows_.clear();
+    block_ = 0;
+    used_ = 0;
+    bytes_ = 0;
+}
+
+std::string_view RowBatch::copy(const unsigned char* text, int length) {
+    if (!text || length <= 0) return {};
+    size_t size = static_cast<size_t>(length);
+    while (block_ < blocks_.size() && used_ + size > blockSizes_[block_]) {
+        ++block_;
+        used_ = 0;
+    }
+    if (block_ == blocks_.size()) {
+        // Oversized values get a block of their own
+        size_t blockSize = std::max(kBlockSize, size);
+        blocks_.push_back(std::make_unique<char[]>(blockSize));
+        blockSizes_.push_back(blockSize);
+        used_ = 0;
+    }
+    char* out = blocks_[block_].get() + used_;
+    memcpy(out, text, size);
+    used_ += size;
+    bytes_ += size;
+    return std::string_view(out, size);
+}
+
+TradeStore::TradeStore(const std::string& path) : TradeStore(path, Options()) {}
+
+TradeStore::TradeStore(const std::string& path, Options options) : options_(options) {
+    // The table name is spliced into SQL text
+    if (options_.table != "nodes" && options_.table != "trades") {
+        throw std::runtime_error("Unknown table: " + options_.table);
+    }
+    // No mutex: a store is confined to one thread
+    int rc = sqlite3_open_v2(path.c_str(), &db_,
+                             SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr);
+    if (rc != SQLITE_OK) {
+        std::string error = db_ ? sqlite3_errmsg(db_) : "out of memory";
+        sqlite3_close(db_);
+        db_ = nullptr;
+        throw std::runtime_error("Cannot open database: " + error);
+    }
+    std::string pragmas = "PRAGMA mmap_size=" + std::to_string(options_.mmapSize) + ";"
+                          "PRAGMA query_only=1;";
+    TradeSchema::exec(db_, pragmas.c_str(), "Cannot configure database");
+    if (options_.batchRows == 0) options_.batchRows = 1;
+}
+
+TradeStore::~TradeStore() {
+    for (auto& [sql, stmt] : statements_) {
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db_);
+}
+
+sqlite3_stmt* TradeStore::statement(const std::string& sql) {
+    auto it = statements_.find(sql);
+    if (it != statements_.end()) {
+        sqlite3_reset(it->second);
+        sqlite3_clear_bindings(it->second);
+        return it->second;
+    }
+    sqlite3_stmt* stmt = nullptr;
+    int rc = sqlite3_prepare_v3(db_, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db_)));
+    }
+    statements_.emplace(sql, stmt);
+    return stmt;
+}
+
+sqlite3_stmt* TradeStore::bindRange(const std::string& columns, const ScanRange& range,
+                                    const std::string& order) {
+    // One cached statement per combination of constrained fields
+    std::string date = range.date.empty() ? "" : TradeSchema::storedDate(range.date, options_.table);
+    std::vector<const std::string*> values;
+    std::string where;
+    auto add = [&](const std::string& value, const char* predicate) {
+        if (value.empty()) return;
+        where += where.empty() ? " WHERE " : " AND ";
+        where += predicate;
+        values.push_back(&value);
+    };
+    add(range.type, "type = ?");
+    add(date, "date = ?");
+    add(range.timeFrom, "timestamp >= ?");
+    add(range.timeTo, "timestamp < ?");
+    add(range.expiry, "expiry = ?");
+    std::string expiryKey = TradeSchema::kExpiryKey;
+    std::string expiryFrom = expiryKey + " >= ?", expiryTo = expiryKey + " < ?";
+    add(range.expiryFrom, expiryFrom.c_str());
+    add(range.expiryTo, expiryTo.c_str());
+
+    sqlite3_stmt* stmt = statement("SELECT " + columns + " FROM " + options_.table + where + order + ";");
+    for (size_t i = 0; i < values.size(); ++i) {
+        // Bound values must outlive the step loop; SQLITE_TRANSIENT copies them
+        sqlite3_bind_text(stmt, i + 1, values[i]->data(), values[i]->size(), SQLITE_TRANSIENT);
+    }
+    return stmt;
+}
+
+size_t TradeStore::scan(const ScanRange& range, const std::function<void(const RowBatch&)>& sink) {
+    sqlite3_stmt* stmt = bindRange("guid, type, date, timestamp, expiry, body", range,
+                                   " ORDER BY timestamp");
+    size_t total = 0;
+    batch_.clear();
+    auto text = [&](int column) {
+        return batch_.copy(sqlite3_column_text(stmt, column), sqlite3_column_bytes(stmt, column));
+    };
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        batch_.rows_.push_back({text(0), text(1), text(2), text(3), text(4), text(5)});
+        if (batch_.size() == options_.batchRows) {
+            total += batch_.size();
+            sink(batch_);
+            batch_.clear();
+        }
+    }
+    if (rc != SQLITE_DONE) {
+        sqlite3_reset(stmt);
+        throw std::runtime_error("Scan failed: " + std::string(sqlite3_errmsg(db_)));
+    }
+    if (!batch_.empty()) {
+        total += batch_.size();
+        sink(batch_);
+        batch_.clear();
+    }
+    // Release the read transaction between scans
+    sqlite3_reset(stmt);
+    return total;
+}
+
+size_t TradeStore::count(const ScanRange& range) {
+    sqlite3_stmt* stmt = bindRange("COUNT(*)", range, "");
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        sqlite3_reset(stmt);
+        throw std::runtime_error("Count failed: " + std::string(sqlite3_errmsg(db_)));
+    }
+    size_t rows = sqlite3_column_int64(stmt, 0);
+    sqlite3_reset(stmt);
+    return rows;
+}
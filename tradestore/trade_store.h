@@ -0,0 +1,94 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sqlite3.h>
+
+// Range of nodes to scan; empty fields are unconstrained.
+struct ScanRange {
+    std::string type;
+    std::string date;       // YYYYMMDD, as passed to csv_to_sqlite --date
+    std::string timeFrom;   // inclusive, compared as stored text
+    std::string timeTo;     // exclusive
+    std::string expiry;     // exact stored form, e.g. 18-Oct-24
+    std::string expiryFrom; // YYYYMMDD, inclusive
+    std::string expiryTo;   // YYYYMMDD, exclusive
+};
+
+// One row of a batch. The views point into the batch's arena and stay valid
+// until the batch is cleared or destroyed.
+struct TradeRow {
+    std::string_view guid;
+    std::string_view type;
+    std::string_view date;
+    std::string_view timestamp;
+    std::string_view expiry;
+    std::string_view body;
+};
+
+// Rows handed out by TradeStore::scan. Column text is copied into a few large
+// arena blocks rather than one std::string per field; clear() keeps the
+// blocks, so a reused batch stops allocating once it has grown.
+class RowBatch {
+public:
+    std::span<const TradeRow> rows() const { return rows_; }
+    size_t size() const { return rows_.size(); }
+    bool empty() const { return rows_.empty(); }
+    size_t bytes() const { return bytes_; }
+    void clear();
+
+private:
+    friend class TradeStore;
+    static constexpr size_t kBlockSize = 256 * 1024;
+
+    std::vector<TradeRow> rows_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    std::vector<size_t> blockSizes_;
+    size_t block_ = 0;      // block being filled
+    size_t used_ = 0;       // bytes used in that block
+    size_t bytes_ = 0;
+
+    std::string_view copy(const unsigned char* text, int length);
+};
+
+// Read-only access to a trades.db written by csv_to_sqlite. The connection is
+// opened read-only with the file memory-mapped, and prepared statements are
+// kept per connection keyed by their SQL, so repeated scans skip the parser.
+// A TradeStore, like its connection, belongs to one thread at a time.
+class TradeStore {
+public:
+    struct Options {
+        long long mmapSize = 1LL << 30;     // PRAGMA mmap_size, 0 disables
+        size_t batchRows = 4096;            // rows per RowBatch handed to the sink
+        std::string table = "nodes";        // or "trades", written by csv_to_sqlite --sorted
+    };
+
+    explicit TradeStore(const std::string& path);
+    TradeStore(const std::string& path, Options options);
+    ~TradeStore();
+
+    TradeStore(const TradeStore&) = delete;
+    TradeStore& operator=(const TradeStore&) = delete;
+
+    // Rows of the range in timestamp order, delivered in batches. The batch is
+    // reused after sink returns. Returns the number of rows scanned.
+    size_t scan(const ScanRange& range, const std::function<void(const RowBatch&)>& sink);
+    size_t count(const ScanRange& range);
+
+    size_t cachedStatements() const { return statements_.size(); }
+    sqlite3* handle() const { return db_; }
+
+private:
+    Options options_;
+    sqlite3* db_ = nullptr;
+    std::unordered_map<std::string, sqlite3_stmt*> statements_;
+    RowBatch batch_;
+
+    sqlite3_stmt* statement(const std::string& sql);
+    sqlite3_stmt* bindRange(const std::string& columns, const ScanRange& range,
+                            const std::string& order);
+};
@@ -0,0 +1,108 @@
+//
+// Created by jesse on 10/25/24.
+//
+
+#include "trade_store.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+void printUsage() {
+    std::cout << "Usage: tradestore_bench --db <trades.db> --type <type> --date <date> [options]\n"
+              << "\nScans one trading day repeatedly and reports throughput.\n"
+              << "\nOptions:\n"
+              << "  --from <time>    : Inclusive start of the time window\n"
+              << "  --to <time>      : Exclusive end of the time window\n"
+              << "  --expiry <exp>   : Only rows with this expiry\n"
+              << "  --expiry-from <date> : Inclusive first expiry, YYYYMMDD\n"
+              << "  --expiry-to <date>   : Exclusive last expiry, YYYYMMDD\n"
+              << "  --repeat <n>     : Number of timed scans (default 10)\n"
+              << "  --batch <rows>   : Rows per batch (default 4096)\n"
+              << "  --no-mmap        : Read through the page cache instead of mmap\n"
+              << "  --table <name>   : nodes (default) or the clustered trades table\n"
+              << "\nExample:\n"
+              << "  tradestore_bench --db trades.db --type TSLA --date 20241016\n";
+}
+
+std::string value(int argc, char* argv[], int& i) {
+    if (i + 1 < argc) return argv[++i];
+    throw std::runtime_error("Error: Missing value after " + std::string(argv[i]));
+}
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::string db;
+        ScanRange range;
+        TradeStore::Options options;
+        int repeat = 10;
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--db") db = value(argc, argv, i);
+            else if (arg == "--type") range.type = value(argc, argv, i);
+            else if (arg == "--date") range.date = value(argc, argv, i);
+            else if (arg == "--from") range.timeFrom = value(argc, argv, i);
+            else if (arg == "--to") range.timeTo = value(argc, argv, i);
+            else if (arg == "--expiry") range.expiry = value(argc, argv, i);
+            else if (arg == "--expiry-from") range.expiryFrom = value(argc, argv, i);
+            else if (arg == "--expiry-to") range.expiryTo = value(argc, argv, i);
+            else if (arg == "--repeat") repeat = std::max(1, atoi(value(argc, argv, i).c_str()));
+            else if (arg == "--batch") options.batchRows = strtoul(value(argc, argv, i).c_str(), nullptr, 10);
+            else if (arg == "--no-mmap") options.mmapSize = 0;
+            else if (arg == "--table") options.table = value(argc, argv, i);
+            else if (arg == "--help") {
+                printUsage();
+                return 0;
+            } else {
+                throw std::runtime_error("Error: Unknown argument " + arg);
+            }
+        }
+        if (db.empty() || range.type.empty() || range.date.empty()) {
+            throw std::runtime_error("Missing required arguments: --db --type --date");
+        }
+
+        TradeStore store(db, options);
+        std::cout << "Rows in range: " << store.count(range) << "\n";
+
+        std::vector<double> seconds;
+        size_t rows = 0, bytes = 0, batches = 0, checksum = 0;
+        for (int run = 0; run < repeat; ++run) {
+            rows = bytes = batches = 0;
+            auto start = std::chrono::steady_clock::now();
+            rows = store.scan(range, [&](const RowBatch& batch) {
+                ++batches;
+                bytes += batch.bytes();
+                // Touch every row so the scan cannot be skipped
+                for (const TradeRow& row : batch.rows()) {
+                    checksum += row.timestamp.size() + row.body.size();
+                }
+            });
+            seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        double first = seconds.front();
+        std::sort(seconds.begin(), seconds.end());
+        double best = seconds.front();
+        double median = seconds[seconds.size() / 2];
+        auto rate = [&](double s) { return s > 0 ? rows / s : 0; };
+
+        std::cout << "Scanned " << rows << " rows in " << batches << " batches ("
+                  << bytes / (1024.0 * 1024.0) << " MiB), " << repeat << " runs\n"
+                  << "First:  " << first * 1e3 << " ms, " << rate(first) << " rows/s\n"
+                  << "Best:   " << best * 1e3 << " ms, " << rate(best) << " rows/s, "
+                  << (best > 0 ? bytes / best / (1024.0 * 1024.0) : 0) << " MiB/s\n"
+                  << "Median: " << median * 1e3 << " ms, " << rate(median) << " rows/s\n"
+                  << "Cached statements: " << store.cachedStatements()
+                  << ", checksum " << checksum << "\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        printUsage();
+        return 1;
+    }
+}